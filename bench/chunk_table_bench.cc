@@ -0,0 +1,120 @@
+// chunk_table_bench.cc
+// Per-frame cost of the ChunkManager::update() bookkeeping at render
+// distance 20: the old string-keyed std::unordered_map against ChunkTable.
+// Chunk construction needs a GL context, so a small stand-in is stored
+// instead; both variants pay the same allocation for it on load.
+#include "chunk_table.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+struct FakeChunk {
+    int x, z;
+};
+
+constexpr int RENDER_DISTANCE = 20;
+
+// The pre-ChunkTable ChunkManager::update()/unload_chunks() logic
+struct StringKeyManager {
+    std::unordered_map<std::string, std::unique_ptr<FakeChunk>> chunks;
+    int cameraChunkX = 0;
+    int cameraChunkZ = 0;
+
+    void update(int camX, int camZ) {
+        unload_chunks();
+        this->cameraChunkX = camX;
+        this->cameraChunkZ = camZ;
+        for (int x = camX - RENDER_DISTANCE; x <= camX + RENDER_DISTANCE;
+             x++) {
+            for (int z = camZ - RENDER_DISTANCE; z <= camZ + RENDER_DISTANCE;
+                 z++) {
+                std::string key = get_chunk_key(x, z);
+                if (chunks.find(key) == chunks.end())
+                    chunks[key] = std::make_unique<FakeChunk>(FakeChunk{x, z});
+            }
+        }
+    }
+    void unload_chunks() {
+        for (auto it = chunks.begin(); it != chunks.end();) {
+            size_t delim_pos = it->first.find(':');
+            int chunkX = std::stoi(it->first.substr(0, delim_pos));
+            int chunkZ = std::stoi(it->first.substr(delim_pos + 1));
+            if (std::abs(chunkX - cameraChunkX) > RENDER_DISTANCE or
+                std::abs(chunkZ - cameraChunkZ) > RENDER_DISTANCE) {
+                it = this->chunks.erase(it);
+            } else {
+                it++;
+            }
+        }
+    }
+    std::string get_chunk_key(int x, int z) const {
+        return std::to_string(x) + ":" + std::to_string(z);
+    }
+};
+
+// The ChunkTable-based ChunkManager::update()/unload_chunks() logic
+struct TableManager {
+    ChunkTable<FakeChunk> chunks;
+    int cameraChunkX = 0;
+    int cameraChunkZ = 0;
+
+    void update(int camX, int camZ) {
+        this->chunks.erase_if([this](int x, int z, const FakeChunk &) {
+            return std::abs(x - cameraChunkX) > RENDER_DISTANCE or
+                   std::abs(z - cameraChunkZ) > RENDER_DISTANCE;
+        });
+        this->cameraChunkX = camX;
+        this->cameraChunkZ = camZ;
+        for (int x = camX - RENDER_DISTANCE; x <= camX + RENDER_DISTANCE;
+             x++) {
+            for (int z = camZ - RENDER_DISTANCE; z <= camZ + RENDER_DISTANCE;
+                 z++) {
+                if (!chunks.contains(x, z))
+                    chunks.insert(x, z,
+                                  std::make_unique<FakeChunk>(FakeChunk{x, z}));
+            }
+        }
+    }
+};
+
+// Average microseconds per update(); the camera crosses a chunk border
+// every `frames_per_chunk` frames (0 = stationary).
+template <typename Manager> double run(int frames, int frames_per_chunk) {
+    Manager manager;
+    manager.update(0, 0);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frames; frame++) {
+        int camX = frames_per_chunk ? frame / frames_per_chunk : 0;
+        manager.update(camX, 0);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(end - start).count() /
+           frames;
+}
+
+auto main() -> int {
+    const int frames = 2000;
+    int side = 2 * RENDER_DISTANCE + 1;
+    std::printf("render distance %d, %d chunks, %d frames\n\n",
+                RENDER_DISTANCE, side * side, frames);
+    std::printf("%-22s %14s %14s\n", "scenario", "string map", "ChunkTable");
+
+    struct Scenario {
+        const char *name;
+        int frames_per_chunk;
+    } scenarios[] = {{"stationary", 0}, {"walking (1 chunk/8f)", 8}};
+
+    for (const Scenario &scenario : scenarios) {
+        int step = scenario.frames_per_chunk;
+        double before = run<StringKeyManager>(frames, step);
+        double after = run<TableManager>(frames, step);
+        std::printf("%-22s %11.1f us %11.1f us  (%.1fx)\n", scenario.name,
+                    before, after, before / after);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,184 @@
+// occlusion_bench.cc
+// Per-frame cost of ChunkManager::cull_occluded() at render distance 20,
+// which should stay well under a millisecond. Terrain heights come from
+// the same noise as Chunk::generate_terrain (trees left out, they are not
+// occluders); the camera stands on the ground at the origin and turns
+// through a full circle at a few pitches. Frustum culling runs first, as
+// in ChunkManager::render, and is not counted.
+#include "FastNoiseLite.h"
+#include "frustum.h"
+#include "occlusion.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <glm/gtc/matrix_transform.hpp>
+#include <vector>
+
+constexpr int RENDER_DISTANCE = 20;
+constexpr int CHUNK_SIZE = 32;
+constexpr int OCCLUDER_CELL = 8;
+constexpr int OCCLUDER_CELLS = CHUNK_SIZE / OCCLUDER_CELL;
+constexpr size_t OCCLUDER_CHUNKS = 32;
+
+// What cull_occluded reads from a Chunk
+struct FakeChunk {
+    int x, z;
+    int draw_max_y;
+    uint8_t draw_occluders[OCCLUDER_CELLS][OCCLUDER_CELLS];
+};
+
+static FakeChunk generate(FastNoiseLite &noise, int chunk_x, int chunk_z) {
+    FakeChunk chunk = {chunk_x, chunk_z, 0, {}};
+    int heights[CHUNK_SIZE][CHUNK_SIZE];
+    for (int x = 0; x < CHUNK_SIZE; x++) {
+        for (int z = 0; z < CHUNK_SIZE; z++) {
+            float value = noise.GetNoise((float)(chunk_x * CHUNK_SIZE + x),
+                                         (float)(chunk_z * CHUNK_SIZE + z));
+            int height = (int)((value + 1.0f) * ((float)CHUNK_SIZE / 4));
+            heights[x][z] = std::clamp(height, 0, CHUNK_SIZE - 1);
+            chunk.draw_max_y = std::max(chunk.draw_max_y, heights[x][z]);
+        }
+    }
+    // Columns are solid from y = 0 through their height
+    for (int cx = 0; cx < OCCLUDER_CELLS; cx++) {
+        for (int cz = 0; cz < OCCLUDER_CELLS; cz++) {
+            int lowest = CHUNK_SIZE;
+            for (int x = 0; x < OCCLUDER_CELL; x++) {
+                for (int z = 0; z < OCCLUDER_CELL; z++) {
+                    lowest = std::min(lowest, heights[cx * OCCLUDER_CELL + x]
+                                                     [cz * OCCLUDER_CELL + z]);
+                }
+            }
+            chunk.draw_occluders[cx][cz] = (uint8_t)(lowest + 1);
+        }
+    }
+    return chunk;
+}
+
+static void chunk_bounds(const FakeChunk &chunk, glm::vec3 &min,
+                         glm::vec3 &max) {
+    min = glm::vec3(chunk.x * CHUNK_SIZE, 0, chunk.z * CHUNK_SIZE);
+    max = glm::vec3(min.x + CHUNK_SIZE, chunk.draw_max_y + 1,
+                    min.z + CHUNK_SIZE);
+}
+
+// The body of ChunkManager::cull_occluded; returns the chunks occluded
+static int cull_occluded(OcclusionCuller &occlusion, const glm::mat4 &clip,
+                         std::vector<const FakeChunk *> &visible) {
+    auto distance = [](const FakeChunk *chunk) {
+        return chunk->x * chunk->x + chunk->z * chunk->z;
+    };
+    auto nearest =
+        visible.begin() + std::min(visible.size(), OCCLUDER_CHUNKS);
+    std::partial_sort(visible.begin(), nearest, visible.end(),
+                      [&](const FakeChunk *a, const FakeChunk *b) {
+                          return distance(a) < distance(b);
+                      });
+
+    occlusion.begin(clip);
+    for (auto it = visible.begin(); it != nearest; it++) {
+        const FakeChunk &chunk = **it;
+        for (int cx = 0; cx < OCCLUDER_CELLS; cx++) {
+            int cz = 0;
+            while (cz < OCCLUDER_CELLS) {
+                int height = chunk.draw_occluders[cx][cz];
+                int end = cz + 1;
+                while (end < OCCLUDER_CELLS &&
+                       chunk.draw_occluders[cx][end] == height)
+                    end++;
+                if (height) {
+                    float x = chunk.x * CHUNK_SIZE + cx * OCCLUDER_CELL;
+                    float z = chunk.z * CHUNK_SIZE;
+                    occlusion.add_occluder(
+                        glm::vec3(x, 0, z + cz * OCCLUDER_CELL),
+                        glm::vec3(x + OCCLUDER_CELL, height,
+                                  z + end * OCCLUDER_CELL));
+                }
+                cz = end;
+            }
+        }
+    }
+    occlusion.finish();
+
+    int occluded = 0;
+    std::erase_if(visible, [&](const FakeChunk *chunk) {
+        glm::vec3 min, max;
+        chunk_bounds(*chunk, min, max);
+        if (occlusion.is_visible(min, max))
+            return false;
+        occluded++;
+        return true;
+    });
+    return occluded;
+}
+
+int main() {
+    FastNoiseLite noise;
+    noise.SetNoiseType(FastNoiseLite::NoiseType_OpenSimplex2S);
+    noise.SetFrequency(0.01f);
+    std::vector<FakeChunk> chunks;
+    for (int x = -RENDER_DISTANCE; x <= RENDER_DISTANCE; x++) {
+        for (int z = -RENDER_DISTANCE; z <= RENDER_DISTANCE; z++)
+            chunks.push_back(generate(noise, x, z));
+    }
+
+    // Engine::update's projection at the default zoom, 16:9
+    float far = 1.141f * RENDER_DISTANCE * CHUNK_SIZE;
+    glm::mat4 projection =
+        glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, far);
+    float ground = noise.GetNoise(0.0f, 0.0f);
+    glm::vec3 eye(0.5f, (ground + 1.0f) * (CHUNK_SIZE / 4) + 2.7f, 0.5f);
+
+    constexpr int YAWS = 16;
+    constexpr int REPEATS = 200;
+    const float pitches[] = {0.0f, -20.0f, 20.0f};
+    OcclusionCuller occlusion;
+    std::vector<const FakeChunk *> visible;
+    std::vector<double> times;
+    long in_frustum = 0, occluded = 0;
+    for (float pitch : pitches) {
+        for (int yaw = 0; yaw < YAWS; yaw++) {
+            float yaw_radians = glm::radians(360.0f * yaw / YAWS);
+            float pitch_radians = glm::radians(pitch);
+            glm::vec3 front(std::cos(yaw_radians) * std::cos(pitch_radians),
+                            std::sin(pitch_radians),
+                            std::sin(yaw_radians) * std::cos(pitch_radians));
+            glm::mat4 clip = projection * glm::lookAt(eye, eye + front,
+                                                      glm::vec3(0, 1, 0));
+            Frustum frustum(clip);
+            for (int repeat = 0; repeat < REPEATS; repeat++) {
+                visible.clear();
+                for (const FakeChunk &chunk : chunks) {
+                    glm::vec3 min, max;
+                    chunk_bounds(chunk, min, max);
+                    if (frustum.intersects(min, max))
+                        visible.push_back(&chunk);
+                }
+                in_frustum += visible.size();
+
+                auto start = std::chrono::steady_clock::now();
+                occluded += cull_occluded(occlusion, clip, visible);
+                double ms = std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() - start)
+                                .count();
+                times.push_back(ms);
+            }
+        }
+    }
+
+    long frames = (long)times.size();
+    double total_ms = 0.0;
+    for (double ms : times)
+        total_ms += ms;
+    std::sort(times.begin(), times.end());
+    std::printf("Render distance %d (%zu chunks), %ld frames\n",
+                RENDER_DISTANCE, chunks.size(), frames);
+    std::printf("In frustum: %.1f chunks/frame, occluded: %.1f\n",
+                (double)in_frustum / frames, (double)occluded / frames);
+    std::printf("cull_occluded: %.4f ms mean, %.4f ms median, %.4f ms p99, "
+                "%.4f ms max\n",
+                total_ms / frames, times[frames / 2], times[frames * 99 / 100],
+                times.back());
+    return 0;
+}
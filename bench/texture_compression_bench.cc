@@ -0,0 +1,114 @@
+// texture_compression_bench.cc
+// Throughput and quality of the CPU block compressors on the block
+// textures, as bake_textures sees them: every PNG of the folder resampled
+// to a 16x16 layer. Quality is the PSNR of the decoded layers against
+// the originals, color over the visible texels. No GL context required.
+// Usage: texture_compression_bench [block dir]
+#define STB_IMAGE_IMPLEMENTATION
+#include "block_compression.h"
+#include "stb_image.h"
+#include "texture_archive.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+constexpr int LAYER_SIZE = 16;
+constexpr size_t LAYER_BYTES = LAYER_SIZE * LAYER_SIZE * 4;
+
+// Runs `work` until at least 200 ms have passed; returns ms per run
+template <typename Work> static double time_ms(Work work) {
+    auto start = std::chrono::steady_clock::now();
+    int runs = 0;
+    double elapsed;
+    do {
+        work();
+        runs++;
+        elapsed = std::chrono::duration<double, std::milli>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+    } while (elapsed < 200.0);
+    return elapsed / runs;
+}
+
+static double psnr(double squared_error, size_t samples) {
+    if (squared_error == 0.0)
+        return INFINITY;
+    return 10.0 * std::log10(255.0 * 255.0 * samples / squared_error);
+}
+
+int main(int argc, char **argv) {
+    const char *folder = argc > 1 ? argv[1] : "src/block";
+    std::vector<unsigned char> layers;
+    std::error_code error;
+    for (const auto &entry :
+         std::filesystem::directory_iterator(folder, error)) {
+        if (entry.path().extension() != ".png")
+            continue;
+        int width, height, channels;
+        unsigned char *image = stbi_load(entry.path().string().c_str(),
+                                         &width, &height, &channels, 4);
+        if (!image)
+            continue;
+        layers.resize(layers.size() + LAYER_BYTES);
+        copy_texture_layer(image, width, height, LAYER_SIZE,
+                           layers.data() + layers.size() - LAYER_BYTES);
+        stbi_image_free(image);
+    }
+    int count = (int)(layers.size() / LAYER_BYTES);
+    if (count == 0) {
+        std::fprintf(stderr, "No PNG files in %s\n", folder);
+        return 1;
+    }
+    double pixels = (double)count * LAYER_SIZE * LAYER_SIZE;
+    std::printf("%d textures of %dx%d from %s\n\n", count, LAYER_SIZE,
+                LAYER_SIZE, folder);
+    std::printf("format  bytes/layer  encode MPix/s  decode MPix/s  "
+                "PSNR rgb  PSNR alpha\n");
+
+    for (TextureFormat format :
+         {TextureFormat::BC1, TextureFormat::BC3, TextureFormat::BC7}) {
+        size_t layer_bytes = texture_bytes(format, LAYER_SIZE, LAYER_SIZE);
+        std::vector<unsigned char> compressed(layer_bytes * count);
+        std::vector<unsigned char> decoded(layers.size());
+        double encode_ms = time_ms([&] {
+            for (int i = 0; i < count; i++) {
+                compress_texture(format, layers.data() + i * LAYER_BYTES,
+                                 LAYER_SIZE, LAYER_SIZE,
+                                 compressed.data() + i * layer_bytes);
+            }
+        });
+        double decode_ms = time_ms([&] {
+            for (int i = 0; i < count; i++) {
+                decompress_texture(format, compressed.data() + i * layer_bytes,
+                                   LAYER_SIZE, LAYER_SIZE,
+                                   decoded.data() + i * LAYER_BYTES);
+            }
+        });
+
+        // Color only counts where the texel is visible; BC1 writes
+        // transparent texels as black whatever color they had
+        double color_error = 0.0, alpha_error = 0.0;
+        size_t texels = layers.size() / 4, visible = 0;
+        for (size_t texel = 0; texel < texels; texel++) {
+            const unsigned char *original = &layers[texel * 4];
+            const unsigned char *result = &decoded[texel * 4];
+            double d = (double)result[3] - original[3];
+            alpha_error += d * d;
+            if (original[3] == 0)
+                continue;
+            visible++;
+            for (int c = 0; c < 3; c++) {
+                d = (double)result[c] - original[c];
+                color_error += d * d;
+            }
+        }
+        std::printf("%-6s  %11zu  %13.1f  %13.1f  %8.2f  %10.2f\n",
+                    texture_format_name(format), layer_bytes,
+                    pixels / encode_ms / 1000.0, pixels / decode_ms / 1000.0,
+                    psnr(color_error, visible * 3), psnr(alpha_error, texels));
+    }
+    return 0;
+}
@@ -1,20 +1,22 @@
 // block.h
 #pragma once
+#include <cstdint>
 
 struct Block {
-    enum class BlockType { Bedrock, Air, Dirt, Sun, Wood, Leaf, Grass, Sand};
-    enum BlockTexture : int {
-        GRASS_TOP = 0,
-        GRASS_SIDE = 1,
-        GRASS_BOTTOM = 2,
-        WOOD = 3,
-        LEAF = 4,
-        SAND = 5,
-        WOOD_TOP = 6,
+    // Ids of the blocks the terrain generator refers to directly. Every other
+    // block in blocks.txt gets an id after these from the BlockRegistry.
+    enum class BlockType : uint16_t {
+        Bedrock,
+        Air,
+        Dirt,
+        Sun,
+        Wood,
+        Leaf,
+        Grass,
+        Sand
     };
-    BlockType type;
-    BlockTexture top;
-    BlockTexture side;
-    BlockTexture bottom;
+    static constexpr const char *builtin_names[] = {
+        "bedrock", "air", "dirt", "sun", "wood", "leaf", "grass", "sand"};
+    static constexpr int BUILTIN_COUNT =
+        sizeof(builtin_names) / sizeof(builtin_names[0]);
 };
-
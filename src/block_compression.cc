@@ -0,0 +1,977 @@
+// block_compression.cc
+#include "block_compression.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+constexpr const char *FORMAT_NAMES[] = {"RGBA8", "BC1", "BC3", "BC7"};
+
+// Fraction of the way from c0 to c1 of each BC1 palette entry
+constexpr float FOUR_COLOR_WEIGHTS[4] = {0.0f, 1.0f, 1.0f / 3, 2.0f / 3};
+constexpr float THREE_COLOR_WEIGHTS[4] = {0.0f, 1.0f, 0.5f, 0.0f};
+// BC7 interpolation weights for 4-bit and 2-bit indices, out of 64
+constexpr int BC7_WEIGHTS[16] = {0,  4,  9,  13, 17, 21, 26, 30,
+                                 34, 38, 43, 47, 51, 55, 60, 64};
+constexpr int BC7_WEIGHTS_3[8] = {0, 9, 18, 27, 37, 46, 55, 64};
+constexpr int BC7_WEIGHTS_2[4] = {0, 21, 43, 64};
+constexpr int ALL_TEXELS[16] = {0, 1, 2,  3,  4,  5,  6,  7,
+                                8, 9, 10, 11, 12, 13, 14, 15};
+// BC7 two-subset partitions: bit i is set when texel i is in subset 1
+constexpr uint16_t BC7_PARTITIONS[64] = {
+    0xCCCC, 0x8888, 0xEEEE, 0xECC8, 0xC880, 0xFEEC, 0xFEC8, 0xEC80,
+    0xC800, 0xFFEC, 0xFE80, 0xE800, 0xFFE8, 0xFF00, 0xFFF0, 0xF000,
+    0xF710, 0x008E, 0x7100, 0x08CE, 0x008C, 0x7310, 0x3100, 0x8CCE,
+    0x088C, 0x3110, 0x6666, 0x366C, 0x17E8, 0x0FF0, 0x718E, 0x399C,
+    0xAAAA, 0xF0F0, 0x5A5A, 0x33CC, 0x3C3C, 0x55AA, 0x9696, 0xA55A,
+    0x73CE, 0x13C8, 0x324C, 0x3BDC, 0x6996, 0xC33C, 0x9966, 0x0660,
+    0x0272, 0x04E4, 0x4E40, 0x2720, 0xC936, 0x936C, 0x39C6, 0x639C,
+    0x9336, 0x9CC6, 0x817E, 0xE718, 0xCCF0, 0x0FCC, 0x7744, 0xEE22};
+// Anchor texel of subset 1 per partition; subset 0's is texel 0
+constexpr int BC7_ANCHORS[64] = {
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 2,  8,  2,  2,  8,  8,  15, 2,  8,  2,  2,  8,  8,  2,  2,
+    15, 15, 6,  8,  2,  8,  15, 15, 2,  8,  2,  2,  2,  15, 15, 6,
+    6,  2,  6,  8,  15, 15, 2,  2,  15, 15, 15, 15, 15, 2,  2,  15};
+// Partitioned candidates fully encoded per block, best estimates first
+constexpr int BC7_PARTITION_CANDIDATES = 2;
+
+float clamp_channel(float value) { return std::clamp(value, 0.0f, 255.0f); }
+
+// Mean and principal axis of the first `channels` channels of the points,
+// by power iteration on their covariance. The axis is zero when the
+// points are all equal.
+void principal_axis(const float (*points)[4], int count, int channels,
+                    float mean[4], float axis[4]) {
+    for (int c = 0; c < 4; c++) {
+        mean[c] = 0.0f;
+        for (int i = 0; i < count; i++)
+            mean[c] += points[i][c];
+        mean[c] /= count;
+    }
+    float covariance[4][4] = {};
+    for (int i = 0; i < count; i++) {
+        for (int a = 0; a < channels; a++) {
+            for (int b = 0; b < channels; b++) {
+                covariance[a][b] +=
+                    (points[i][a] - mean[a]) * (points[i][b] - mean[b]);
+            }
+        }
+    }
+    // Start from the row of the channel that varies most
+    int widest = 0;
+    for (int c = 1; c < channels; c++) {
+        if (covariance[c][c] > covariance[widest][widest])
+            widest = c;
+    }
+    for (int c = 0; c < 4; c++)
+        axis[c] = c < channels ? covariance[widest][c] : 0.0f;
+    for (int iteration = 0; iteration < 8; iteration++) {
+        float next[4] = {};
+        float largest = 0.0f;
+        for (int a = 0; a < channels; a++) {
+            for (int b = 0; b < channels; b++)
+                next[a] += covariance[a][b] * axis[b];
+            largest = std::max(largest, std::fabs(next[a]));
+        }
+        if (largest == 0.0f)
+            break;
+        for (int c = 0; c < channels; c++)
+            axis[c] = next[c] / largest;
+    }
+    float length = 0.0f;
+    for (int c = 0; c < channels; c++)
+        length += axis[c] * axis[c];
+    length = std::sqrt(length);
+    for (int c = 0; c < 4; c++)
+        axis[c] = length > 0.0f ? axis[c] / length : 0.0f;
+}
+
+// Endpoints at the extremes of the points along their principal axis
+void axis_endpoints(const float (*points)[4], int count, int channels,
+                    float e0[4], float e1[4]) {
+    float mean[4], axis[4];
+    principal_axis(points, count, channels, mean, axis);
+    float low = 0.0f, high = 0.0f;
+    for (int i = 0; i < count; i++) {
+        float t = 0.0f;
+        for (int c = 0; c < channels; c++)
+            t += (points[i][c] - mean[c]) * axis[c];
+        low = std::min(low, t);
+        high = std::max(high, t);
+    }
+    for (int c = 0; c < 4; c++) {
+        e0[c] = clamp_channel(mean[c] + axis[c] * low);
+        e1[c] = clamp_channel(mean[c] + axis[c] * high);
+    }
+}
+
+// Least-squares endpoints for points interpolated at `weights` (0 at e0,
+// 1 at e1); false when the weights cannot separate two endpoints
+bool fit_endpoints(const float (*points)[4], const float *weights, int count,
+                   int channels, float e0[4], float e1[4]) {
+    float a = 0.0f, b = 0.0f, c = 0.0f;
+    float r0[4] = {}, r1[4] = {};
+    for (int i = 0; i < count; i++) {
+        float w = weights[i], u = 1.0f - w;
+        a += u * u;
+        b += u * w;
+        c += w * w;
+        for (int k = 0; k < channels; k++) {
+            r0[k] += u * points[i][k];
+            r1[k] += w * points[i][k];
+        }
+    }
+    float determinant = a * c - b * b;
+    if (std::fabs(determinant) < 1e-6f)
+        return false;
+    for (int k = 0; k < channels; k++) {
+        e0[k] = clamp_channel((c * r0[k] - b * r1[k]) / determinant);
+        e1[k] = clamp_channel((a * r1[k] - b * r0[k]) / determinant);
+    }
+    return true;
+}
+
+int to_565(const float color[4]) {
+    int r = (int)(color[0] * 31.0f / 255.0f + 0.5f);
+    int g = (int)(color[1] * 63.0f / 255.0f + 0.5f);
+    int b = (int)(color[2] * 31.0f / 255.0f + 0.5f);
+    return r << 11 | g << 5 | b;
+}
+
+void from_565(int packed, int color[3]) {
+    int r = packed >> 11 & 31, g = packed >> 5 & 63, b = packed & 31;
+    color[0] = r << 3 | r >> 2;
+    color[1] = g << 2 | g >> 4;
+    color[2] = b << 3 | b >> 2;
+}
+
+// Palette of a BC1 color block; entry 3 is transparent black in the
+// three-color mode (c0 <= c1)
+void color_palette(int c0, int c1, bool four_color, int palette[4][3]) {
+    from_565(c0, palette[0]);
+    from_565(c1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+        int a = palette[0][c], b = palette[1][c];
+        if (four_color) {
+            palette[2][c] = (2 * a + b) / 3;
+            palette[3][c] = (a + 2 * b) / 3;
+        } else {
+            palette[2][c] = (a + b) / 2;
+            palette[3][c] = 0;
+        }
+    }
+}
+
+void write_color_block(int c0, int c1, uint32_t indices,
+                       unsigned char *block) {
+    block[0] = c0 & 0xFF;
+    block[1] = c0 >> 8;
+    block[2] = c1 & 0xFF;
+    block[3] = c1 >> 8;
+    for (int i = 0; i < 4; i++)
+        block[4 + i] = indices >> (i * 8) & 0xFF;
+}
+
+// The color half of BC1 and BC3. With `punch_through`, texels with alpha
+// below 128 force the three-color mode and use its transparent entry;
+// otherwise the block is always four-color, as BC3 requires.
+void encode_color_block(const unsigned char *pixels, bool punch_through,
+                        unsigned char *block) {
+    float points[16][4];
+    int texels[16];
+    int count = 0;
+    for (int i = 0; i < 16; i++) {
+        if (punch_through && pixels[i * 4 + 3] < 128)
+            continue;
+        for (int c = 0; c < 4; c++)
+            points[count][c] = pixels[i * 4 + c];
+        texels[count++] = i;
+    }
+    if (count == 0) {
+        write_color_block(0, 0, 0xFFFFFFFF, block);
+        return;
+    }
+    bool four_color = count == 16;
+    const float *weights =
+        four_color ? FOUR_COLOR_WEIGHTS : THREE_COLOR_WEIGHTS;
+
+    float e0[4], e1[4];
+    axis_endpoints(points, count, 3, e0, e1);
+    int best_error = -1, best_c0 = 0, best_c1 = 0;
+    uint32_t best_indices = 0;
+    for (int iteration = 0; iteration < 3; iteration++) {
+        int c0 = to_565(e0), c1 = to_565(e1);
+        // Four-color blocks need c0 > c1, three-color ones c0 <= c1
+        if (four_color ? c0 < c1 : c0 > c1)
+            std::swap(c0, c1);
+        int entries = four_color ? (c0 == c1 ? 1 : 4) : 3;
+        int palette[4][3];
+        color_palette(c0, c1, four_color, palette);
+
+        uint32_t indices = four_color ? 0 : 0xFFFFFFFF;
+        float fit_weights[16];
+        int error = 0;
+        for (int i = 0; i < count; i++) {
+            int best = 0, best_distance = -1;
+            for (int entry = 0; entry < entries; entry++) {
+                int distance = 0;
+                for (int c = 0; c < 3; c++) {
+                    int d = palette[entry][c] - (int)points[i][c];
+                    distance += d * d;
+                }
+                if (best_distance < 0 || distance < best_distance) {
+                    best = entry;
+                    best_distance = distance;
+                }
+            }
+            int shift = texels[i] * 2;
+            indices = (indices & ~(3u << shift)) | (uint32_t)best << shift;
+            fit_weights[i] = weights[best];
+            error += best_distance;
+        }
+        if (best_error < 0 || error < best_error) {
+            best_error = error;
+            best_c0 = c0;
+            best_c1 = c1;
+            best_indices = indices;
+        }
+        if (error == 0 ||
+            !fit_endpoints(points, fit_weights, count, 3, e0, e1))
+            break;
+    }
+    write_color_block(best_c0, best_c1, best_indices, block);
+}
+
+void decode_color_block(const unsigned char *block, bool always_four_color,
+                        unsigned char *pixels) {
+    int c0 = block[0] | block[1] << 8;
+    int c1 = block[2] | block[3] << 8;
+    bool four_color = always_four_color || c0 > c1;
+    int palette[4][3];
+    color_palette(c0, c1, four_color, palette);
+    uint32_t indices =
+        block[4] | block[5] << 8 | block[6] << 16 | (uint32_t)block[7] << 24;
+    for (int i = 0; i < 16; i++) {
+        int index = indices >> (i * 2) & 3;
+        for (int c = 0; c < 3; c++)
+            pixels[i * 4 + c] = palette[index][c];
+        pixels[i * 4 + 3] = !four_color && index == 3 ? 0 : 255;
+    }
+}
+
+// Palette of a BC3 alpha block: a0 > a1 interpolates eight values,
+// otherwise six plus 0 and 255
+void alpha_palette(int a0, int a1, int palette[8]) {
+    palette[0] = a0;
+    palette[1] = a1;
+    if (a0 > a1) {
+        for (int i = 1; i < 7; i++)
+            palette[i + 1] = ((7 - i) * a0 + i * a1 + 3) / 7;
+    } else {
+        for (int i = 1; i < 5; i++)
+            palette[i + 1] = ((5 - i) * a0 + i * a1 + 2) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+// Indices and squared error of the alpha block (a0, a1)
+int alpha_indices(const unsigned char *pixels, int a0, int a1,
+                  uint64_t &indices) {
+    int palette[8];
+    alpha_palette(a0, a1, palette);
+    indices = 0;
+    int error = 0;
+    for (int i = 0; i < 16; i++) {
+        int alpha = pixels[i * 4 + 3];
+        int best = 0;
+        for (int entry = 1; entry < 8; entry++) {
+            if (std::abs(palette[entry] - alpha) <
+                std::abs(palette[best] - alpha))
+                best = entry;
+        }
+        indices |= (uint64_t)best << (i * 3);
+        error += (palette[best] - alpha) * (palette[best] - alpha);
+    }
+    return error;
+}
+
+// The alpha half of BC3: the eight-value mode over the full range, or the
+// six-value mode over the texels that are neither 0 nor 255
+void encode_alpha_block(const unsigned char *pixels, unsigned char *block) {
+    int low = 255, high = 0, inner_low = 255, inner_high = 0;
+    for (int i = 0; i < 16; i++) {
+        int alpha = pixels[i * 4 + 3];
+        low = std::min(low, alpha);
+        high = std::max(high, alpha);
+        if (alpha != 0 && alpha != 255) {
+            inner_low = std::min(inner_low, alpha);
+            inner_high = std::max(inner_high, alpha);
+        }
+    }
+    if (inner_low > inner_high)
+        inner_low = inner_high = 0;
+    uint64_t indices, six_indices;
+    int a0 = high, a1 = low;
+    int error = alpha_indices(pixels, a0, a1, indices);
+    if (alpha_indices(pixels, inner_low, inner_high, six_indices) < error) {
+        a0 = inner_low;
+        a1 = inner_high;
+        indices = six_indices;
+    }
+    block[0] = a0;
+    block[1] = a1;
+    for (int i = 0; i < 6; i++)
+        block[2 + i] = indices >> (i * 8) & 0xFF;
+}
+
+void decode_alpha_block(const unsigned char *block, unsigned char *pixels) {
+    int palette[8];
+    alpha_palette(block[0], block[1], palette);
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; i++)
+        indices |= (uint64_t)block[2 + i] << (i * 8);
+    for (int i = 0; i < 16; i++)
+        pixels[i * 4 + 3] = palette[indices >> (i * 3) & 7];
+}
+
+// BC7 fields are packed from the lowest bit of the first byte up
+struct BitWriter {
+    unsigned char *data;
+    int bit = 0;
+
+    void write(uint32_t value, int bits) {
+        for (int i = 0; i < bits; i++, this->bit++) {
+            if (value >> i & 1)
+                this->data[this->bit >> 3] |= 1 << (this->bit & 7);
+        }
+    }
+};
+
+struct BitReader {
+    const unsigned char *data;
+    int bit = 0;
+
+    uint32_t read(int bits) {
+        uint32_t value = 0;
+        for (int i = 0; i < bits; i++, this->bit++)
+            value |= (uint32_t)(this->data[this->bit >> 3] >>
+                                    (this->bit & 7) &
+                                1)
+                     << i;
+        return value;
+    }
+};
+
+// Fits an endpoint pair to channels [first, first + channels) of the
+// `count` texels listed in `texels`, alternating nearest-weight indices
+// with a least-squares refit. `quantize` rounds both endpoints to 8-bit
+// values the mode can store. Returns the squared error, with the
+// endpoints in `values` and the weight of each listed texel in `indices`.
+template <typename Quantize>
+int fit_bc7_endpoints(const unsigned char *pixels, const int *texels,
+                      int count, int first, int channels, const int *weights,
+                      int levels, Quantize quantize, int values[2][4],
+                      int indices[16]) {
+    float points[16][4] = {};
+    for (int i = 0; i < count; i++) {
+        for (int k = 0; k < channels; k++)
+            points[i][k] = pixels[texels[i] * 4 + first + k];
+    }
+    float e0[4], e1[4];
+    axis_endpoints(points, count, channels, e0, e1);
+
+    int best_error = -1;
+    for (int iteration = 0; iteration < 3; iteration++) {
+        int endpoints[2][4] = {};
+        quantize(e0, e1, endpoints);
+        int palette[16][4];
+        for (int level = 0; level < levels; level++) {
+            for (int k = 0; k < channels; k++) {
+                palette[level][k] = ((64 - weights[level]) * endpoints[0][k] +
+                                     weights[level] * endpoints[1][k] + 32) >>
+                                    6;
+            }
+        }
+
+        int fit_indices[16];
+        float fit_weights[16];
+        int error = 0;
+        for (int i = 0; i < count; i++) {
+            int best = 0, best_distance = -1;
+            for (int level = 0; level < levels; level++) {
+                int distance = 0;
+                for (int k = 0; k < channels; k++) {
+                    int d = palette[level][k] - (int)points[i][k];
+                    distance += d * d;
+                }
+                if (best_distance < 0 || distance < best_distance) {
+                    best = level;
+                    best_distance = distance;
+                }
+            }
+            fit_indices[i] = best;
+            fit_weights[i] = weights[best] / 64.0f;
+            error += best_distance;
+        }
+        if (best_error < 0 || error < best_error) {
+            best_error = error;
+            std::memcpy(values, endpoints, sizeof(endpoints));
+            for (int i = 0; i < count; i++)
+                indices[texels[i]] = fit_indices[i];
+        }
+        if (error == 0 ||
+            !fit_endpoints(points, fit_weights, count, channels, e0, e1))
+            break;
+    }
+    return best_error;
+}
+
+// Expands an n-bit endpoint value to 8 bits by repeating its top bits
+int expand_bc7_value(int value, int bits) {
+    return (value << (8 - bits) | value >> (2 * bits - 8)) & 255;
+}
+
+// Rounds the first `channels` channels of a color to `bits`-bit values
+// followed by the low bit `bit`, returned expanded to 8 bits, with the
+// squared error
+float quantize_bc7_endpoint(const float color[4], int channels, int bits,
+                            int bit, int values[4]) {
+    int top = (1 << bits) - 1;
+    float scale = (float)((1 << (bits + 1)) - 1) / 255.0f;
+    float error = 0.0f;
+    for (int c = 0; c < channels; c++) {
+        int q = std::clamp((int)std::lround((color[c] * scale - bit) / 2), 0,
+                           top);
+        values[c] = expand_bc7_value(q << 1 | bit, bits + 1);
+        float d = values[c] - color[c];
+        error += d * d;
+    }
+    return error;
+}
+
+// Endpoint with its own low bit, whichever rounds closer
+void quantize_bc7_unique_bit(const float color[4], int channels, int bits,
+                             int values[4]) {
+    int other[4];
+    float error0 = quantize_bc7_endpoint(color, channels, bits, 0, values);
+    if (quantize_bc7_endpoint(color, channels, bits, 1, other) < error0)
+        std::copy(other, other + 4, values);
+}
+
+// The anchor index of a set is stored without its top bit; swaps the
+// endpoints and mirrors the indices of the set's texels when it is set
+void fix_bc7_anchor(int values[2][4], int indices[16], int levels,
+                    int anchor = 0, const int *texels = ALL_TEXELS,
+                    int count = 16) {
+    if (indices[anchor] < levels / 2)
+        return;
+    for (int k = 0; k < 4; k++)
+        std::swap(values[0][k], values[1][k]);
+    for (int i = 0; i < count; i++)
+        indices[texels[i]] = levels - 1 - indices[texels[i]];
+}
+
+// Mode 6: one RGBA line with 4-bit weights. Endpoints are seven bits per
+// channel plus one low bit shared by the endpoint's channels.
+int encode_bc7_mode6(const unsigned char *pixels, unsigned char *block) {
+    auto quantize = [](const float e0[4], const float e1[4],
+                       int values[2][4]) {
+        quantize_bc7_unique_bit(e0, 4, 7, values[0]);
+        quantize_bc7_unique_bit(e1, 4, 7, values[1]);
+    };
+    int values[2][4], indices[16];
+    int error = fit_bc7_endpoints(pixels, ALL_TEXELS, 16, 0, 4, BC7_WEIGHTS,
+                                  16, quantize, values, indices);
+    fix_bc7_anchor(values, indices, 16);
+
+    std::memset(block, 0, 16);
+    BitWriter writer{block};
+    writer.write(1 << 6, 7);
+    for (int c = 0; c < 4; c++) {
+        writer.write(values[0][c] >> 1, 7);
+        writer.write(values[1][c] >> 1, 7);
+    }
+    writer.write(values[0][0] & 1, 1);
+    writer.write(values[1][0] & 1, 1);
+    for (int i = 0; i < 16; i++)
+        writer.write(indices[i], i == 0 ? 3 : 4);
+    return error;
+}
+
+// Mode 5: separate RGB and alpha lines with 2-bit weights each, RGB
+// endpoints in seven bits and alpha in eight. Suits blocks whose alpha
+// does not follow their color, like cut-out leaves.
+int encode_bc7_mode5(const unsigned char *pixels, unsigned char *block) {
+    auto quantize_color = [](const float e0[4], const float e1[4],
+                             int values[2][4]) {
+        for (int c = 0; c < 3; c++) {
+            int q0 = std::clamp((int)std::lround(e0[c] * 127.0f / 255.0f), 0,
+                                127);
+            int q1 = std::clamp((int)std::lround(e1[c] * 127.0f / 255.0f), 0,
+                                127);
+            values[0][c] = expand_bc7_value(q0, 7);
+            values[1][c] = expand_bc7_value(q1, 7);
+        }
+    };
+    auto quantize_alpha = [](const float e0[4], const float e1[4],
+                             int values[2][4]) {
+        values[0][0] = std::clamp((int)std::lround(e0[0]), 0, 255);
+        values[1][0] = std::clamp((int)std::lround(e1[0]), 0, 255);
+    };
+    int colors[2][4], color_indices[16];
+    int alphas[2][4], alpha_indices[16];
+    int error = fit_bc7_endpoints(pixels, ALL_TEXELS, 16, 0, 3, BC7_WEIGHTS_2,
+                                  4, quantize_color, colors, color_indices) +
+                fit_bc7_endpoints(pixels, ALL_TEXELS, 16, 3, 1, BC7_WEIGHTS_2,
+                                  4, quantize_alpha, alphas, alpha_indices);
+    fix_bc7_anchor(colors, color_indices, 4);
+    fix_bc7_anchor(alphas, alpha_indices, 4);
+
+    std::memset(block, 0, 16);
+    BitWriter writer{block};
+    writer.write(1 << 5, 6);
+    writer.write(0, 2); // no channel rotation
+    for (int c = 0; c < 3; c++) {
+        writer.write(colors[0][c] >> 1, 7);
+        writer.write(colors[1][c] >> 1, 7);
+    }
+    writer.write(alphas[0][0], 8);
+    writer.write(alphas[1][0], 8);
+    for (int i = 0; i < 16; i++)
+        writer.write(color_indices[i], i == 0 ? 1 : 2);
+    for (int i = 0; i < 16; i++)
+        writer.write(alpha_indices[i], i == 0 ? 1 : 2);
+    return error;
+}
+
+// Texels of each subset of a two-subset partition, in texel order
+int partition_subsets(int partition, int texels[2][16], int counts[2]) {
+    counts[0] = counts[1] = 0;
+    for (int i = 0; i < 16; i++) {
+        int subset = BC7_PARTITIONS[partition] >> i & 1;
+        texels[subset][counts[subset]++] = i;
+    }
+    return counts[1];
+}
+
+// Sums over a set of texels: count, channel sums and channel products
+struct TexelMoments {
+    float count = 0.0f;
+    float sum[4] = {};
+    float products[4][4] = {};
+
+    TexelMoments() = default;
+    TexelMoments(const unsigned char *texel, int channels) {
+        this->count = 1.0f;
+        for (int a = 0; a < channels; a++) {
+            this->sum[a] = texel[a];
+            for (int b = 0; b < channels; b++)
+                this->products[a][b] = (float)texel[a] * texel[b];
+        }
+    }
+    void add(const TexelMoments &other, float sign = 1.0f) {
+        this->count += sign * other.count;
+        for (int a = 0; a < 4; a++) {
+            this->sum[a] += sign * other.sum[a];
+            for (int b = 0; b < 4; b++)
+                this->products[a][b] += sign * other.products[a][b];
+        }
+    }
+
+    // Squared distance of the texels from their principal axis: the
+    // total variance less the largest eigenvalue of the scatter matrix,
+    // which power iteration finds
+    float line_residual(int channels) const {
+        if (this->count < 2.0f)
+            return 0.0f;
+        float scatter[4][4];
+        float trace = 0.0f;
+        for (int a = 0; a < channels; a++) {
+            for (int b = 0; b < channels; b++) {
+                scatter[a][b] = this->products[a][b] -
+                                this->sum[a] * this->sum[b] / this->count;
+            }
+            trace += scatter[a][a];
+        }
+        float axis[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+        float eigenvalue = 0.0f;
+        for (int iteration = 0; iteration < 4; iteration++) {
+            float next[4] = {};
+            float length = 0.0f;
+            for (int a = 0; a < channels; a++) {
+                for (int b = 0; b < channels; b++)
+                    next[a] += scatter[a][b] * axis[b];
+                length += next[a] * next[a];
+            }
+            if (length <= 0.0f)
+                return std::max(trace, 0.0f);
+            length = std::sqrt(length);
+            eigenvalue = length;
+            for (int a = 0; a < channels; a++)
+                axis[a] = next[a] / length;
+        }
+        return std::max(trace - eigenvalue, 0.0f);
+    }
+};
+
+// Estimated error of each two-subset partition: the distance of every
+// texel from its subset's principal axis, before quantization
+void partition_residuals(const unsigned char *pixels, int channels,
+                         float residuals[64]) {
+    TexelMoments texels[16], all;
+    for (int i = 0; i < 16; i++) {
+        texels[i] = TexelMoments(pixels + i * 4, channels);
+        all.add(texels[i]);
+    }
+    for (int partition = 0; partition < 64; partition++) {
+        TexelMoments subset;
+        for (int i = 0; i < 16; i++) {
+            if (BC7_PARTITIONS[partition] >> i & 1)
+                subset.add(texels[i]);
+        }
+        TexelMoments rest = all;
+        rest.add(subset, -1.0f);
+        residuals[partition] =
+            subset.line_residual(channels) + rest.line_residual(channels);
+    }
+}
+
+// Mode 1 (opaque) and mode 7 (with alpha): one line per subset of a
+// two-subset partition, for blocks mixing two hues. Mode 1 stores RGB in
+// six bits plus a low bit shared by both endpoints of a subset, with
+// 3-bit weights; mode 7 stores RGBA in five bits plus a low bit per
+// endpoint, with 2-bit weights.
+int encode_bc7_partitioned(const unsigned char *pixels, int mode,
+                           int partition, unsigned char *block) {
+    bool alpha = mode == 7;
+    int channels = alpha ? 4 : 3;
+    int bits = alpha ? 5 : 6;
+    int index_bits = alpha ? 2 : 3;
+    int levels = 1 << index_bits;
+    const int *weights = alpha ? BC7_WEIGHTS_2 : BC7_WEIGHTS_3;
+    auto quantize = [&](const float e0[4], const float e1[4],
+                        int values[2][4]) {
+        if (alpha) {
+            quantize_bc7_unique_bit(e0, 4, bits, values[0]);
+            quantize_bc7_unique_bit(e1, 4, bits, values[1]);
+            return;
+        }
+        int other[2][4];
+        float error0 = quantize_bc7_endpoint(e0, 3, bits, 0, values[0]) +
+                       quantize_bc7_endpoint(e1, 3, bits, 0, values[1]);
+        float error1 = quantize_bc7_endpoint(e0, 3, bits, 1, other[0]) +
+                       quantize_bc7_endpoint(e1, 3, bits, 1, other[1]);
+        if (error1 < error0)
+            std::memcpy(values, other, sizeof(other));
+    };
+
+    int texels[2][16], counts[2];
+    partition_subsets(partition, texels, counts);
+    int anchors[2] = {0, BC7_ANCHORS[partition]};
+    int values[2][2][4] = {}, indices[16];
+    int error = 0;
+    for (int subset = 0; subset < 2; subset++) {
+        error += fit_bc7_endpoints(pixels, texels[subset], counts[subset], 0,
+                                   channels, weights, levels, quantize,
+                                   values[subset], indices);
+        fix_bc7_anchor(values[subset], indices, levels, anchors[subset],
+                       texels[subset], counts[subset]);
+    }
+
+    // Values are expanded to 8 bits; the stored ones are their top
+    // `bits`, then the low bit
+    int shift = 8 - (bits + 1);
+    std::memset(block, 0, 16);
+    BitWriter writer{block};
+    writer.write(1 << mode, mode + 1);
+    writer.write(partition, 6);
+    for (int c = 0; c < channels; c++) {
+        for (int subset = 0; subset < 2; subset++) {
+            writer.write(values[subset][0][c] >> (shift + 1), bits);
+            writer.write(values[subset][1][c] >> (shift + 1), bits);
+        }
+    }
+    for (int subset = 0; subset < 2; subset++) {
+        for (int endpoint = 0; endpoint < (alpha ? 2 : 1); endpoint++)
+            writer.write(values[subset][endpoint][0] >> shift & 1, 1);
+    }
+    for (int i = 0; i < 16; i++) {
+        bool anchor = i == anchors[0] || i == anchors[1];
+        writer.write(indices[i], anchor ? index_bits - 1 : index_bits);
+    }
+    return error;
+}
+
+// Encodes the partitions whose estimated error is lowest and keeps the
+// best one in `block` if it beats `error`; returns the error of `block`
+int try_bc7_partitions(const unsigned char *pixels, bool opaque, int error,
+                       unsigned char *block) {
+    int mode = opaque ? 1 : 7;
+    int channels = opaque ? 3 : 4;
+    float residuals[64];
+    int order[64];
+    partition_residuals(pixels, channels, residuals);
+    for (int partition = 0; partition < 64; partition++)
+        order[partition] = partition;
+    std::partial_sort(
+        order, order + BC7_PARTITION_CANDIDATES, order + 64,
+        [&](int a, int b) { return residuals[a] < residuals[b]; });
+    for (int i = 0; i < BC7_PARTITION_CANDIDATES; i++) {
+        unsigned char candidate[16];
+        int candidate_error =
+            encode_bc7_partitioned(pixels, mode, order[i], candidate);
+        if (candidate_error < error) {
+            error = candidate_error;
+            std::memcpy(block, candidate, 16);
+        }
+    }
+    return error;
+}
+
+// Reads a block written by encode_bc7_partitioned
+void decode_bc7_partitioned(const unsigned char *block, int mode,
+                            unsigned char *pixels) {
+    bool alpha = mode == 7;
+    int channels = alpha ? 4 : 3;
+    int bits = alpha ? 5 : 6;
+    int index_bits = alpha ? 2 : 3;
+    const int *weights = alpha ? BC7_WEIGHTS_2 : BC7_WEIGHTS_3;
+    BitReader reader{block, mode + 1};
+    int partition = reader.read(6);
+    int values[2][2][4];
+    for (int c = 0; c < 4; c++) {
+        for (int subset = 0; subset < 2; subset++) {
+            for (int endpoint = 0; endpoint < 2; endpoint++)
+                values[subset][endpoint][c] =
+                    c < channels ? reader.read(bits) << 1 : 255;
+        }
+    }
+    for (int subset = 0; subset < 2; subset++) {
+        int shared = alpha ? 0 : reader.read(1);
+        for (int endpoint = 0; endpoint < 2; endpoint++) {
+            int bit = alpha ? reader.read(1) : shared;
+            for (int c = 0; c < channels; c++) {
+                values[subset][endpoint][c] = expand_bc7_value(
+                    values[subset][endpoint][c] | bit, bits + 1);
+            }
+        }
+    }
+    int anchor = BC7_ANCHORS[partition];
+    for (int i = 0; i < 16; i++) {
+        bool is_anchor = i == 0 || i == anchor;
+        int weight =
+            weights[reader.read(is_anchor ? index_bits - 1 : index_bits)];
+        const int(*endpoints)[4] =
+            values[BC7_PARTITIONS[partition] >> i & 1];
+        for (int c = 0; c < 4; c++) {
+            pixels[i * 4 + c] = ((64 - weight) * endpoints[0][c] +
+                                 weight * endpoints[1][c] + 32) >>
+                                6;
+        }
+    }
+}
+
+// Copies the block with its fully transparent texels recolored to the
+// mean of the visible ones, so their arbitrary color, which nobody sees,
+// does not pull the fitted endpoints away from the colors that show
+void hide_transparent_colors(const unsigned char *pixels,
+                             unsigned char *out) {
+    int sum[3] = {}, visible = 0;
+    for (int i = 0; i < 16; i++) {
+        if (pixels[i * 4 + 3] == 0)
+            continue;
+        for (int c = 0; c < 3; c++)
+            sum[c] += pixels[i * 4 + c];
+        visible++;
+    }
+    std::memcpy(out, pixels, 64);
+    if (visible == 0 || visible == 16)
+        return;
+    for (int i = 0; i < 16; i++) {
+        if (pixels[i * 4 + 3] != 0)
+            continue;
+        for (int c = 0; c < 3; c++)
+            out[i * 4 + c] = (sum[c] + visible / 2) / visible;
+    }
+}
+
+} // namespace
+
+const char *texture_format_name(TextureFormat format) {
+    return FORMAT_NAMES[(int)format];
+}
+
+bool parse_texture_format(const char *name, TextureFormat &format) {
+    for (int i = 0; i < 4; i++) {
+        const char *expected = FORMAT_NAMES[i];
+        size_t length = std::strlen(expected);
+        if (std::strlen(name) != length)
+            continue;
+        bool match = true;
+        for (size_t k = 0; k < length; k++)
+            match &= std::toupper((unsigned char)name[k]) == expected[k];
+        if (match) {
+            format = (TextureFormat)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void encode_bc1_block(const unsigned char *pixels, unsigned char *block) {
+    encode_color_block(pixels, true, block);
+}
+
+void encode_bc3_block(const unsigned char *pixels, unsigned char *block) {
+    unsigned char visible[64];
+    hide_transparent_colors(pixels, visible);
+    encode_alpha_block(visible, block);
+    encode_color_block(visible, false, block + 8);
+}
+
+void encode_bc7_block(const unsigned char *pixels, unsigned char *block) {
+    unsigned char visible[64];
+    hide_transparent_colors(pixels, visible);
+    int error = encode_bc7_mode6(visible, block);
+    if (error == 0)
+        return;
+    bool opaque = true;
+    for (int i = 0; i < 16; i++)
+        opaque &= visible[i * 4 + 3] == 255;
+    if (!opaque) {
+        unsigned char mode5[16];
+        int mode5_error = encode_bc7_mode5(visible, mode5);
+        if (mode5_error < error) {
+            error = mode5_error;
+            std::memcpy(block, mode5, 16);
+        }
+    }
+    try_bc7_partitions(visible, opaque, error, block);
+}
+
+void decode_bc1_block(const unsigned char *block, unsigned char *pixels) {
+    decode_color_block(block, false, pixels);
+}
+
+void decode_bc3_block(const unsigned char *block, unsigned char *pixels) {
+    decode_color_block(block + 8, true, pixels);
+    decode_alpha_block(block, pixels);
+}
+
+void decode_bc7_block(const unsigned char *block, unsigned char *pixels) {
+    int mode = 0;
+    while (mode < 8 && !(block[0] >> mode & 1))
+        mode++;
+    if (mode == 1 || mode == 7) {
+        decode_bc7_partitioned(block, mode, pixels);
+        return;
+    }
+    if (mode != 5 && mode != 6) {
+        std::memset(pixels, 0, 64);
+        return;
+    }
+    BitReader reader{block, mode + 1};
+    int rotation = mode == 5 ? reader.read(2) : 0;
+    int endpoints[2][4];
+    for (int c = 0; c < 3; c++) {
+        endpoints[0][c] = reader.read(7) << 1;
+        endpoints[1][c] = reader.read(7) << 1;
+    }
+    if (mode == 6) {
+        endpoints[0][3] = reader.read(7) << 1;
+        endpoints[1][3] = reader.read(7) << 1;
+        int bit0 = reader.read(1), bit1 = reader.read(1);
+        for (int c = 0; c < 4; c++) {
+            endpoints[0][c] |= bit0;
+            endpoints[1][c] |= bit1;
+        }
+        for (int i = 0; i < 16; i++) {
+            int weight = BC7_WEIGHTS[reader.read(i == 0 ? 3 : 4)];
+            for (int c = 0; c < 4; c++) {
+                pixels[i * 4 + c] = ((64 - weight) * endpoints[0][c] +
+                                     weight * endpoints[1][c] + 32) >>
+                                    6;
+            }
+        }
+        return;
+    }
+
+    for (int c = 0; c < 3; c++) {
+        endpoints[0][c] |= endpoints[0][c] >> 7;
+        endpoints[1][c] |= endpoints[1][c] >> 7;
+    }
+    endpoints[0][3] = reader.read(8);
+    endpoints[1][3] = reader.read(8);
+    // Color weights for every texel come before the alpha weights
+    for (int set = 0; set < 2; set++) {
+        for (int i = 0; i < 16; i++) {
+            int weight = BC7_WEIGHTS_2[reader.read(i == 0 ? 1 : 2)];
+            for (int c = set ? 3 : 0; c < (set ? 4 : 3); c++) {
+                pixels[i * 4 + c] = ((64 - weight) * endpoints[0][c] +
+                                     weight * endpoints[1][c] + 32) >>
+                                    6;
+            }
+        }
+    }
+    // Rotation 1-3 swaps alpha with red, green or blue
+    if (rotation) {
+        for (int i = 0; i < 16; i++)
+            std::swap(pixels[i * 4 + 3], pixels[i * 4 + rotation - 1]);
+    }
+}
+
+void compress_texture(TextureFormat format, const unsigned char *rgba,
+                      int width, int height, unsigned char *out) {
+    if (!is_block_compressed(format)) {
+        std::memcpy(out, rgba, texture_bytes(format, width, height));
+        return;
+    }
+    void (*encode)(const unsigned char *, unsigned char *) =
+        format == TextureFormat::BC1   ? encode_bc1_block
+        : format == TextureFormat::BC3 ? encode_bc3_block
+                                       : encode_bc7_block;
+    unsigned char pixels[64];
+    for (int by = 0; by < height; by += 4) {
+        for (int bx = 0; bx < width; bx += 4) {
+            for (int y = 0; y < 4; y++) {
+                int sy = std::min(by + y, height - 1);
+                for (int x = 0; x < 4; x++) {
+                    int sx = std::min(bx + x, width - 1);
+                    std::memcpy(pixels + (y * 4 + x) * 4,
+                                rgba + ((size_t)sy * width + sx) * 4, 4);
+                }
+            }
+            encode(pixels, out);
+            out += block_bytes(format);
+        }
+    }
+}
+
+void decompress_texture(TextureFormat format, const unsigned char *data,
+                        int width, int height, unsigned char *rgba) {
+    if (!is_block_compressed(format)) {
+        std::memcpy(rgba, data, texture_bytes(format, width, height));
+        return;
+    }
+    void (*decode)(const unsigned char *, unsigned char *) =
+        format == TextureFormat::BC1   ? decode_bc1_block
+        : format == TextureFormat::BC3 ? decode_bc3_block
+                                       : decode_bc7_block;
+    unsigned char pixels[64];
+    for (int by = 0; by < height; by += 4) {
+        for (int bx = 0; bx < width; bx += 4) {
+            decode(data, pixels);
+            data += block_bytes(format);
+            for (int y = 0; y < 4 && by + y < height; y++) {
+                for (int x = 0; x < 4 && bx + x < width; x++) {
+                    std::memcpy(rgba + ((size_t)(by + y) * width + bx + x) * 4,
+                                pixels + (y * 4 + x) * 4, 4);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,50 @@
+// block_compression.h
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Pixel formats of baked textures. The BCn formats store each 4x4 block
+// of pixels in a fixed number of bytes that the GPU samples directly:
+// BC1 (DXT1) 8 bytes with 1-bit alpha, BC3 (DXT5) 16 bytes with BC1 color
+// plus interpolated alpha, BC7 16 bytes at higher quality.
+enum class TextureFormat : uint32_t { RGBA8, BC1, BC3, BC7 };
+
+const char *texture_format_name(TextureFormat format);
+// Parses a texture_format_name() case-insensitively; false if unknown
+bool parse_texture_format(const char *name, TextureFormat &format);
+
+inline bool is_block_compressed(TextureFormat format) {
+    return format != TextureFormat::RGBA8;
+}
+// Bytes of one 4x4 block
+inline int block_bytes(TextureFormat format) {
+    return format == TextureFormat::BC1 ? 8 : 16;
+}
+// Bytes of a width x height image; partial blocks take a whole block
+inline size_t texture_bytes(TextureFormat format, int width, int height) {
+    if (!is_block_compressed(format))
+        return (size_t)width * height * 4;
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) *
+           block_bytes(format);
+}
+
+// Single blocks: `pixels` is 16 RGBA texels, row by row. BC1 keeps
+// texels with alpha below 128 as transparent black. BC7 is written in
+// whichever fits best of mode 6 (one RGBA line), mode 5 (separate RGB and
+// alpha lines, when alpha varies apart from color) and the two-subset
+// modes 1 (opaque) and 7 (with alpha), which give each half of a
+// multi-hue block its own line. decode_bc7_block reads only those four
+// and decodes the other modes to transparent black.
+void encode_bc1_block(const unsigned char *pixels, unsigned char *block);
+void encode_bc3_block(const unsigned char *pixels, unsigned char *block);
+void encode_bc7_block(const unsigned char *pixels, unsigned char *block);
+void decode_bc1_block(const unsigned char *block, unsigned char *pixels);
+void decode_bc3_block(const unsigned char *block, unsigned char *pixels);
+void decode_bc7_block(const unsigned char *block, unsigned char *pixels);
+
+// Whole RGBA images, blocks row by row. Edge blocks of images that are
+// not a multiple of 4 repeat the last row and column.
+void compress_texture(TextureFormat format, const unsigned char *rgba,
+                      int width, int height, unsigned char *out);
+void decompress_texture(TextureFormat format, const unsigned char *data,
+                        int width, int height, unsigned char *rgba);
@@ -0,0 +1,122 @@
+// block_registry.cc
+#include "block_registry.h"
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+BlockRegistry::BlockRegistry() {
+    this->tints.push_back(glm::vec3(1.0f));
+    for (const char *name : Block::builtin_names)
+        this->add_block(name);
+    this->opaque[(int)Block::BlockType::Air] = 0;
+}
+
+bool BlockRegistry::load(const std::string &path) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Failed to load block registry: " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line)) {
+        line_number++;
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream fields(line);
+        std::string name, top, side, bottom, tint;
+        int opaque, animated;
+        if (!(fields >> name))
+            continue;
+        if (!(fields >> opaque >> top >> side >> bottom >> tint >> animated)) {
+            std::cerr << path << ":" << line_number
+                      << ": expected 7 columns, skipping " << name << "\n";
+            continue;
+        }
+
+        int id = (int)this->find(name);
+        if (id == (int)Block::BlockType::Air && name != "air")
+            id = this->add_block(name);
+
+        int tint_faces = 0;
+        this->tint[id] = 0;
+        if (tint != "-") {
+            tint_faces = 0b111111;
+            if (tint.starts_with("top:")) {
+                tint_faces = 0b000001;
+                tint = tint.substr(4);
+            }
+            unsigned int rgb = std::strtoul(tint.c_str(), nullptr, 16);
+            this->tint[id] = (uint8_t)this->tint_index(
+                glm::vec3((rgb >> 16 & 0xFF) / 255.0f,
+                          (rgb >> 8 & 0xFF) / 255.0f, (rgb & 0xFF) / 255.0f));
+        }
+
+        this->opaque[id] = (uint8_t)(opaque != 0);
+        this->animated[id] = (uint8_t)(animated != 0);
+
+        // Chunk face order: top, bottom, front, back, left, right
+        int layers[3] = {this->texture_layer(top), this->texture_layer(side),
+                         this->texture_layer(bottom)};
+        for (int face = 0; face < 6; face++) {
+            int attribute = face == 0   ? layers[0]
+                            : face == 1 ? layers[2]
+                                        : layers[1];
+            if (tint_faces & (1 << face))
+                attribute |= this->tint[id] << TINT_SHIFT;
+            if (this->animated[id])
+                attribute |= ANIMATED_BIT;
+            this->face_attributes[id * 6 + face] = attribute;
+        }
+    }
+
+    std::cout << "Loaded " << this->count() << " blocks, "
+              << this->textures.size() << " textures.\n";
+    return true;
+}
+
+Block::BlockType BlockRegistry::find(const std::string &name) const {
+    for (int id = 0; id < this->count(); id++) {
+        if (this->names[id] == name)
+            return (Block::BlockType)id;
+    }
+    return Block::BlockType::Air;
+}
+
+int BlockRegistry::add_block(const std::string &name) {
+    this->names.push_back(name);
+    this->opaque.push_back(1);
+    this->tint.push_back(0);
+    this->animated.push_back(0);
+    this->face_attributes.insert(this->face_attributes.end(), 6, 0);
+    return this->count() - 1;
+}
+
+int BlockRegistry::texture_layer(const std::string &name) {
+    if (name == "-")
+        return 0;
+    for (size_t i = 0; i < this->textures.size(); i++) {
+        if (this->textures[i] == name)
+            return (int)i;
+    }
+    if ((int)this->textures.size() >= MAX_TEXTURES) {
+        std::cerr << "Block texture limit (" << MAX_TEXTURES
+                  << ") reached, " << name << " uses layer 0\n";
+        return 0;
+    }
+    this->textures.push_back(name);
+    return (int)this->textures.size() - 1;
+}
+
+int BlockRegistry::tint_index(const glm::vec3 &color) {
+    for (size_t i = 0; i < this->tints.size(); i++) {
+        if (this->tints[i] == color)
+            return (int)i;
+    }
+    if ((int)this->tints.size() >= MAX_TINTS)
+        return 0;
+    this->tints.push_back(color);
+    return (int)this->tints.size() - 1;
+}
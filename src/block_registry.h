@@ -0,0 +1,52 @@
+// block_registry.h
+#pragma once
+#include "block.h"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Block properties loaded from blocks.txt. Every block id owns one row in
+// flat per-property arrays so the mesher can resolve a face with a single
+// table lookup instead of switching on the block type.
+struct BlockRegistry {
+    static constexpr int MAX_TINTS = 16;
+
+    // Packed per-face vertex attribute read by vertex.glsl:
+    // texture layer (bits 0-11), tint index (bits 12-15, 0 = no tint) and
+    // the animated flag (bit 16).
+    static constexpr int LAYER_MASK = 0xFFF;
+    // Block textures are the layers of one texture array (see
+    // load_texture_array), limited by the bits of a layer index.
+    static constexpr int MAX_TEXTURES = LAYER_MASK + 1;
+    static constexpr int TINT_SHIFT = 12;
+    static constexpr int ANIMATED_BIT = 1 << 16;
+
+    std::vector<std::string> names;
+    std::vector<uint8_t> opaque;
+    std::vector<uint8_t> tint;
+    std::vector<uint8_t> animated;
+    std::vector<int> face_attributes; // 6 per block, in Chunk face order
+
+    std::vector<std::string> textures; // texture layer -> file name
+    std::vector<glm::vec3> tints;      // tint index -> color
+
+    BlockRegistry();
+
+    bool load(const std::string &path);
+
+    int count() const { return (int)this->names.size(); }
+    Block::BlockType find(const std::string &name) const;
+
+    bool is_opaque(Block::BlockType type) const {
+        return this->opaque[(int)type];
+    }
+    int face_attribute(Block::BlockType type, int face) const {
+        return this->face_attributes[(int)type * 6 + face];
+    }
+
+  private:
+    int add_block(const std::string &name);
+    int texture_layer(const std::string &name);
+    int tint_index(const glm::vec3 &color);
+};
@@ -0,0 +1,124 @@
+// block_storage.h
+#pragma once
+#include "block.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Palette-compressed voxel storage. Each voxel stores a small local index
+// into `palette`, bit-packed into 64-bit words. The index width grows
+// 0 -> 1 -> 2 -> 4 -> 8 -> 16 bits as new block types are written, so a
+// chunk holding only air, dirt and grass costs 2 bits per voxel. At 0 bits
+// the storage is uniform: the single palette entry is the value of every
+// voxel and no index data is allocated.
+struct BlockStorage {
+    explicit BlockStorage(int size,
+                          Block::BlockType fill = Block::BlockType::Air) {
+        this->size = size;
+        this->palette.push_back(fill);
+    }
+
+    Block::BlockType get(int index) const {
+        return this->palette[this->read(index)];
+    }
+
+    void set(int index, Block::BlockType type) {
+        int local = this->palette_index(type);
+        if (local < 0) {
+            local = (int)this->palette.size();
+            this->palette.push_back(type);
+            if (local > (int)this->mask())
+                this->resize(this->bits == 0 ? 1 : this->bits * 2);
+        }
+        if (this->bits > 0)
+            this->write(index, (uint64_t)local);
+    }
+
+    // Sets every voxel to `type` and drops the index data.
+    void fill(Block::BlockType type) {
+        this->palette.assign(1, type);
+        this->bits = 0;
+        this->data.clear();
+        this->data.shrink_to_fit();
+    }
+
+    // Collapses back to uniform storage if edits left a single block type.
+    void compact() {
+        if (this->bits == 0)
+            return;
+        uint64_t first = this->read(0);
+        for (int i = 1; i < this->size; i++) {
+            if (this->read(i) != first)
+                return;
+        }
+        this->fill(this->palette[first]);
+    }
+
+    bool is_uniform() const { return this->bits == 0; }
+    Block::BlockType uniform_value() const { return this->palette[0]; }
+    int bits_per_entry() const { return this->bits; }
+    int palette_size() const { return (int)this->palette.size(); }
+    // May still list a type that edits have since overwritten everywhere
+    Block::BlockType palette_entry(int i) const { return this->palette[i]; }
+
+    size_t memory_usage() const {
+        return sizeof(*this) +
+               this->palette.capacity() * sizeof(Block::BlockType) +
+               this->data.capacity() * sizeof(uint64_t);
+    }
+
+  private:
+    int size;
+    int bits = 0;
+    std::vector<Block::BlockType> palette;
+    std::vector<uint64_t> data;
+
+    uint64_t mask() const { return (1ull << this->bits) - 1; }
+
+    int palette_index(Block::BlockType type) const {
+        for (size_t i = 0; i < this->palette.size(); i++) {
+            if (this->palette[i] == type)
+                return (int)i;
+        }
+        return -1;
+    }
+
+    uint64_t read(int index) const {
+        if (this->bits == 0)
+            return 0;
+        int per_word = 64 / this->bits;
+        int shift = (index % per_word) * this->bits;
+        return (this->data[index / per_word] >> shift) & this->mask();
+    }
+
+    void write(int index, uint64_t local) {
+        int per_word = 64 / this->bits;
+        int shift = (index % per_word) * this->bits;
+        uint64_t &word = this->data[index / per_word];
+        word = (word & ~(this->mask() << shift)) | (local << shift);
+    }
+
+    // Repacks every voxel at the new width; bits always divides 64 so no
+    // entry straddles two words. Growing from 0 bits leaves every index at
+    // 0, the previous uniform value.
+    void resize(int new_bits) {
+        std::vector<uint64_t> old = std::move(this->data);
+        int old_bits = this->bits;
+
+        this->bits = new_bits;
+        int per_word = 64 / this->bits;
+        this->data.assign((this->size + per_word - 1) / per_word, 0);
+
+        if (old_bits == 0)
+            return;
+
+        int old_per_word = 64 / old_bits;
+        uint64_t old_mask = (1ull << old_bits) - 1;
+        for (int i = 0; i < this->size; i++) {
+            uint64_t local =
+                (old[i / old_per_word] >> ((i % old_per_word) * old_bits)) &
+                old_mask;
+            this->write(i, local);
+        }
+    }
+};
@@ -1,28 +1,23 @@
 // chunk.cc
 #include "glad.h"
 #include "chunk.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
 
-Chunk::Chunk(int x, int z) {
+Chunk::Chunk(int x, int z, const BlockRegistry *registry) {
     this->chunk_position.x = x;
     this->chunk_position.y = z;
+    this->registry = registry;
+    this->sections.assign(SECTION_COUNT, BlockStorage(SECTION_VOLUME));
+    std::fill(std::begin(this->mesh_connectivity),
+              std::end(this->mesh_connectivity), ALL_FACE_PAIRS);
+    std::fill(std::begin(this->draw_connectivity),
+              std::end(this->draw_connectivity), ALL_FACE_PAIRS);
     this->noise = std::make_unique<FastNoiseLite>();
     this->noise->SetNoiseType(FastNoiseLite::NoiseType_OpenSimplex2S);
-
-    glGenVertexArrays(1, &this->vao);
-    glGenBuffers(1, &this->vbo);
-    glGenBuffers(1, &this->vbo_type);
-    glGenBuffers(1, &this->ebo);
-
-    this->generate_terrain();
-    this->build_mesh();
-    this->upload_to_gpu();
-}
-Chunk::~Chunk() {
-    glDeleteVertexArrays(1, &this->vao);
-    glDeleteBuffers(1, &this->vbo);
-    glDeleteBuffers(1, &this->vbo_type);
-    glDeleteBuffers(1, &this->ebo);
 }
+Chunk::~Chunk() { this->release_gpu(); }
 
 void Chunk::generate_terrain() {
     this->noise->SetFrequency(0.01f);
@@ -35,6 +30,14 @@ void Chunk::generate_terrain() {
         biome = Biome::Desert;
     }
 
+    // Seeded from the chunk coordinates rather than rand(): this runs on
+    // worker threads, and a chunk must get the same trees every time
+    std::minstd_rand rng((uint32_t)(int)this->chunk_position.x * 73856093u ^
+                         (uint32_t)(int)this->chunk_position.y * 19349663u);
+
+    int heights[CHUNK_SIZE][CHUNK_SIZE];
+    int minHeight = CHUNK_SIZE - 1;
+    int maxHeight = 0;
     for (int x = 0; x < CHUNK_SIZE; x++) {
         for (int z = 0; z < CHUNK_SIZE; z++) {
             float worldX = this->chunk_position.x * CHUNK_SIZE + x;
@@ -45,41 +48,44 @@ void Chunk::generate_terrain() {
             int sectionHeight = (int)temp;
             sectionHeight = glm::clamp(sectionHeight, 0, CHUNK_SIZE - 1);
 
-            for (int y = 0; y < CHUNK_SIZE; y++) {
-                if (y <= sectionHeight) {
-                    switch (biome) {
-                    case Biome::Plains:
-                        this->blocks[x][y][z].type = Block::BlockType::Dirt;
-                        this->blocks[x][y][z].top =
-                            Block::BlockTexture::GRASS_TOP;
-                        this->blocks[x][y][z].bottom =
-                            Block::BlockTexture::GRASS_BOTTOM;
-                        this->blocks[x][y][z].side =
-                            Block::BlockTexture::GRASS_SIDE;
-
-                        if (y == sectionHeight)
-                            this->blocks[x][y][z].type =
-                                Block::BlockType::Grass;
-                        break;
-                    case Biome::Desert:
-                        this->blocks[x][y][z].type = Block::BlockType::Sand;
-                        this->blocks[x][y][z].top = Block::BlockTexture::SAND;
-                        this->blocks[x][y][z].bottom =
-                            Block::BlockTexture::SAND;
-                        this->blocks[x][y][z].side = Block::BlockTexture::SAND;
-                        break;
-                    default:
-                        break;
-                    }
-                } else {
-                    this->blocks[x][y][z].type = Block::BlockType::Air;
-                }
+            heights[x][z] = sectionHeight;
+            minHeight = std::min(minHeight, sectionHeight);
+            maxHeight = std::max(maxHeight, sectionHeight);
+        }
+    }
+
+    Block::BlockType fill = biome == Biome::Desert ? Block::BlockType::Sand
+                                                   : Block::BlockType::Dirt;
+    Block::BlockType surface = biome == Biome::Desert
+                                   ? Block::BlockType::Sand
+                                   : Block::BlockType::Grass;
+
+    // Sections below the lowest column are solid filler and sections above
+    // the highest column stay air; only the ones in between are written per
+    // voxel.
+    for (int section = 0; section < SECTION_COUNT; section++) {
+        int bottom = section * SECTION_HEIGHT;
+        int top = bottom + SECTION_HEIGHT - 1;
+        if (top < minHeight) {
+            this->sections[section].fill(fill);
+            continue;
+        }
+        if (bottom > maxHeight)
+            continue;
+
+        for (int x = 0; x < CHUNK_SIZE; x++) {
+            for (int z = 0; z < CHUNK_SIZE; z++) {
+                int height = heights[x][z];
+                for (int y = bottom; y <= std::min(top, height); y++)
+                    this->set_block(x, y, z, y == height ? surface : fill);
             }
         }
     }
 
-    if (biome == Biome::Desert)
+    if (biome == Biome::Desert) {
+        this->rebuild_occupancy();
         return;
+    }
 
     for (int x = 0; x < CHUNK_SIZE; x++) {
         for (int z = 0; z < CHUNK_SIZE; z++) {
@@ -88,39 +94,35 @@ void Chunk::generate_terrain() {
 
             int y = CHUNK_SIZE - 1;
             while (y >= 0 &&
-                   this->blocks[x][y][z].type == Block::BlockType::Air) {
+                   this->get_block(x, y, z) == Block::BlockType::Air) {
                 y--;
             }
 
-            if (y >= 0 &&
-                this->blocks[x][y][z].type == Block::BlockType::Grass) {
-                this->blocks[x][y][z].type = Block::BlockType::Wood;
+            if (y >= 0 && this->get_block(x, y, z) == Block::BlockType::Grass) {
                 float treeValue =
                     this->noise->GetNoise(worldX * 10, worldZ * 10);
                 if (x >= 2 and x < CHUNK_SIZE - 2 and z >= 2 and
                     z < CHUNK_SIZE - 2) {
                     if (treeValue > 0.89f and y < CHUNK_SIZE - 6) {
-                        generate_tree(x, y + 1, z);
+                        generate_tree(x, y + 1, z, rng);
                     }
                 }
             }
         }
     }
+    this->rebuild_occupancy();
 }
-void Chunk::generate_tree(int x, int y, int z) {
+void Chunk::generate_tree(int x, int y, int z, std::minstd_rand &rng) {
     int requiredSpace = 5;
     if (x < requiredSpace || x >= CHUNK_SIZE - requiredSpace ||
         z < requiredSpace || z >= CHUNK_SIZE - requiredSpace) {
         return;
     }
 
-    int treeHeight = 5 + (rand() % 2);
+    int treeHeight = 5 + (int)(rng() % 2);
 
     for (int dy = 0; dy < treeHeight && y + dy < CHUNK_SIZE; dy++) {
-        this->blocks[x][y + dy][z].type = Block::BlockType::Wood;
-        this->blocks[x][y + dy][z].top = Block::BlockTexture::WOOD_TOP;
-        this->blocks[x][y + dy][z].bottom = Block::BlockTexture::WOOD_TOP;
-        this->blocks[x][y + dy][z].side = Block::BlockTexture::WOOD;
+        this->set_block(x, y + dy, z, Block::BlockType::Wood);
     }
 
     int leafStartY = y + treeHeight - 3;
@@ -134,175 +136,533 @@ void Chunk::generate_tree(int x, int y, int z) {
                 if (radius == 2 && (abs(lx - x) == 2 && abs(lz - z) == 2)) {
                     continue;
                 }
-                this->blocks[lx][ly][lz].type = Block::BlockType::Leaf;
-                this->blocks[lx][ly][lz].top = Block::BlockTexture::LEAF;
-                this->blocks[lx][ly][lz].bottom = Block::BlockTexture::LEAF;
-                this->blocks[lx][ly][lz].side = Block::BlockTexture::LEAF;
+                this->set_block(lx, ly, lz, Block::BlockType::Leaf);
+            }
+        }
+    }
+}
+int Chunk::render(const glm::vec3 &camera, uint8_t sections) {
+    glm::ivec2 chunk(this->chunk_position.x, this->chunk_position.y);
+    int drawn = 0;
+    for (int section = 0; section < SECTION_COUNT; section++) {
+        const MeshRange &range = this->mesh_ranges[section];
+        if (range.quads == 0 || !(sections & (1 << section)))
+            continue;
+
+        // A face is seen only from the side its normal points to, and the
+        // section's faces of one direction lie within its bounds
+        float bottom = section * SECTION_HEIGHT;
+        const bool facing[6] = {
+            camera.y > bottom,                  // Top
+            camera.y < bottom + SECTION_HEIGHT, // Bottom
+            camera.z > 0,                       // Front
+            camera.z < CHUNK_SIZE,              // Back
+            camera.x < CHUNK_SIZE,              // Left
+            camera.x > 0                        // Right
+        };
+
+        // Consecutive facing groups share one draw
+        int offset = range.offset;
+        int run_start = offset, run_quads = 0;
+        for (int face = 0; face <= 6; face++) {
+            if (face < 6 && facing[face]) {
+                run_quads += range.face_quads[face];
+                offset += range.face_quads[face];
+                continue;
             }
+            if (run_quads) {
+                this->buffer->draw(chunk, run_start, run_quads);
+                drawn += run_quads;
+            }
+            if (face < 6)
+                offset += range.face_quads[face];
+            run_start = offset;
+            run_quads = 0;
         }
     }
+    return drawn;
 }
-void Chunk::render() {
-    glBindVertexArray(this->vao);
-    glDrawElements(GL_TRIANGLES, (GLsizei)this->index_data.size(), GL_UNSIGNED_INT, 0);
+int Chunk::uploaded_quads(uint8_t sections) const {
+    int quads = 0;
+    for (int section = 0; section < SECTION_COUNT; section++) {
+        if (sections & (1 << section))
+            quads += this->mesh_ranges[section].quads;
+    }
+    return quads;
 }
-void Chunk::build_mesh() {
-    this->vertex_data.clear();
-    this->index_data.clear();
-    this->texture_index_data.clear();
+void Chunk::build_mesh(const Chunk *const neighbors[4], MeshMode mode,
+                       uint8_t sections) {
+    this->border_faces_culled = 0;
+    FaceMasks faces;
+    this->compute_face_masks(neighbors, faces);
+
+    for (int section = 0; section < SECTION_COUNT; section++) {
+        if (sections & (1 << section))
+            this->build_section_mesh(faces, mode, section);
+    }
 
-    vertex_data.reserve(CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE * 6 * 8);
-    texture_index_data.reserve(CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE * 6);
+    this->upload_sections |= sections;
+    for (int section = 0; section < SECTION_COUNT; section++) {
+        if (sections & (1 << section))
+            this->mesh_connectivity[section] =
+                this->section_connectivity(section);
+    }
 
-    int idx = 0;
+    uint32_t layers = 0;
+    const Occupancy &solid = this->solid_mask();
     for (int x = 0; x < CHUNK_SIZE; x++) {
-        for (int y = 0; y < CHUNK_SIZE; y++) {
-            for (int z = 0; z < CHUNK_SIZE; z++) {
-                if (this->blocks[x][y][z].type == Block::BlockType::Air)
-                    continue;
-
-                bool occluded[6] = {false, false, false, false, false, false};
-
-                if (x > 0 &&
-                    this->blocks[x - 1][y][z].type != Block::BlockType::Air)
-                    occluded[4] = true;
-                if (x < CHUNK_SIZE - 1 &&
-                    this->blocks[x + 1][y][z].type != Block::BlockType::Air)
-                    occluded[5] = true;
-                if (y > 0 &&
-                    this->blocks[x][y - 1][z].type != Block::BlockType::Air)
-                    occluded[1] = true;
-                if (y < CHUNK_SIZE - 1 &&
-                    this->blocks[x][y + 1][z].type != Block::BlockType::Air)
-                    occluded[0] = true;
-                if (z > 0 &&
-                    this->blocks[x][y][z - 1].type != Block::BlockType::Air)
-                    occluded[3] = true;
-                if (z < CHUNK_SIZE - 1 &&
-                    this->blocks[x][y][z + 1].type != Block::BlockType::Air)
-                    occluded[2] = true;
-
-                if (occluded[0] && occluded[1] && occluded[2] && occluded[3] &&
-                    occluded[4] && occluded[5]) {
-                    continue;
+        for (int z = 0; z < CHUNK_SIZE; z++)
+            layers |= solid.cols_y[x][z];
+    }
+    this->mesh_min_y = layers ? std::countr_zero(layers) : CHUNK_SIZE;
+    this->mesh_max_y = layers ? 31 - std::countl_zero(layers) : -1;
+    for (int cx = 0; cx < OCCLUDER_CELLS; cx++) {
+        for (int cz = 0; cz < OCCLUDER_CELLS; cz++) {
+            uint32_t filled = ~0u;
+            for (int x = 0; x < OCCLUDER_CELL; x++) {
+                for (int z = 0; z < OCCLUDER_CELL; z++) {
+                    filled &= this->opaque.cols_y[cx * OCCLUDER_CELL + x]
+                                                 [cz * OCCLUDER_CELL + z];
                 }
-                add_block_to_mesh(x, y, z, idx, occluded);
             }
+            this->mesh_occluders[cx][cz] = std::countr_one(filled);
         }
     }
+    this->face_count = 0;
+    for (int count : this->section_faces)
+        this->face_count += count;
 }
 
-void Chunk::add_block_to_mesh(int x, int y, int z, int &index,
-                              const bool occluded[6]) {
-    for (int face = 0; face < 6; face++) {
-        if (occluded[face])
-            continue;
+void Chunk::build_section_mesh(const FaceMasks &faces, MeshMode mode,
+                               int section) {
+    // Quads are appended to a per-thread scratch buffer that keeps its
+    // capacity between builds, so the section's own copy is allocated once
+    // at exactly the mesh size.
+    thread_local std::vector<Vertex> scratch;
+    scratch.clear();
+
+    int bottom = section * SECTION_HEIGHT;
+    int top = bottom + SECTION_HEIGHT - 1;
+    if (this->section_state(section) != SectionState::Empty) {
+        if (mode == MeshMode::Greedy)
+            this->build_greedy_mesh(faces, bottom, top, scratch);
+        else
+            this->build_naive_mesh(faces, bottom, top, scratch);
+    }
 
-        int texIndex;
+    this->vertex_data[section].assign(scratch.begin(), scratch.end());
+    this->vertex_data[section].shrink_to_fit();
+    this->section_faces[section] = (int)scratch.size() / 4;
 
-        switch (face) {
-        case 0:
-            texIndex = this->blocks[x][y][z].top;
-            break;
-        case 1:
-            texIndex = this->blocks[x][y][z].bottom;
-            break;
-        default:
-            texIndex = this->blocks[x][y][z].side;
-            break;
+    // Both builders emit one face direction after another, so counting
+    // each direction's quads gives its run within the section
+    int *face_quads = this->section_face_quads[section];
+    std::fill(face_quads, face_quads + 6, 0);
+    for (size_t i = 0; i < scratch.size(); i += 4)
+        face_quads[scratch[i].position >> 18 & 7]++;
+}
+
+// A face is visible where a solid voxel's neighbor along the face normal is
+// not opaque. Shifting a whole row of the opaque bitset by one lines every
+// voxel up with that neighbor; the bit shifted in at the chunk border comes
+// from the neighbor chunk, or stays 0 (visible) if it is not loaded.
+void Chunk::compute_face_masks(const Chunk *const neighbors[4],
+                               FaceMasks &faces) {
+    const Occupancy &solid = this->solid_mask();
+    const Occupancy &opaque = this->opaque;
+    const Occupancy *side[4];
+    for (int i = 0; i < 4; i++)
+        side[i] = neighbors[i] ? &neighbors[i]->opaque : nullptr;
+    const Occupancy *left = side[LEFT], *right = side[RIGHT];
+    const Occupancy *back = side[BACK], *front = side[FRONT];
+
+    constexpr int last = CHUNK_SIZE - 1;
+    for (int a = 0; a < CHUNK_SIZE; a++) {
+        for (int b = 0; b < CHUNK_SIZE; b++) {
+            // Columns along Y at (x, z) = (a, b)
+            uint32_t s = solid.cols_y[a][b];
+            uint32_t o = opaque.cols_y[a][b];
+            faces[0][a][b] = s & ~(o >> 1);
+            faces[1][a][b] = s & ~(o << 1);
+
+            // Rows along Z at (x, y) = (a, b)
+            uint32_t in_front = front ? (front->rows_z[a][b] & 1) << last : 0;
+            uint32_t in_back = back ? back->rows_z[a][b] >> last : 0;
+            s = solid.rows_z[a][b];
+            o = opaque.rows_z[a][b];
+            faces[2][a][b] = s & ~((o >> 1) | in_front);
+            faces[3][a][b] = s & ~((o << 1) | in_back);
+            this->border_faces_culled +=
+                std::popcount(s & in_front) + std::popcount(s & in_back);
+
+            // Rows along X at (y, z) = (a, b)
+            uint32_t in_left = left ? left->rows_x[a][b] >> last : 0;
+            uint32_t in_right = right ? (right->rows_x[a][b] & 1) << last : 0;
+            s = solid.rows_x[a][b];
+            o = opaque.rows_x[a][b];
+            faces[4][a][b] = s & ~((o << 1) | in_left);
+            faces[5][a][b] = s & ~((o >> 1) | in_right);
+            this->border_faces_culled +=
+                std::popcount(s & in_left) + std::popcount(s & in_right);
         }
+    }
+}
 
-        for (int vertex = 0; vertex < 4; ++vertex) {
-            int i = vertex * 3;
-            int ti = vertex * 2;
+// Block coordinates of bit `bit` in faces[face][a][b]
+static void face_mask_position(int face, int a, int b, int bit, int pos[3]) {
+    int normal = Chunk::face_axes[face][0];
+    pos[normal] = bit;
+    if (normal == 1) { // [x][z]
+        pos[0] = a;
+        pos[2] = b;
+    } else if (normal == 2) { // [x][y]
+        pos[0] = a;
+        pos[1] = b;
+    } else { // [y][z]
+        pos[1] = a;
+        pos[2] = b;
+    }
+}
 
-            float vx = this->face_verticies[face][i] + x;
-            float vy = this->face_verticies[face][i + 1] + y;
-            float vz = this->face_verticies[face][i + 2] + z;
+// Emits the faces of blocks with bottom <= y <= top
+void Chunk::build_naive_mesh(const FaceMasks &faces, int bottom, int top,
+                             std::vector<Vertex> &out) {
+    uint32_t layers = (uint32_t)((1ull << (top + 1)) - (1ull << bottom));
+    for (int face = 0; face < 6; face++) {
+        // Restrict whichever of the word index or the bit is the Y axis
+        int normal = face_axes[face][0];
+        int a_begin = normal == 0 ? bottom : 0;
+        int a_end = normal == 0 ? top + 1 : CHUNK_SIZE;
+        int b_begin = normal == 2 ? bottom : 0;
+        int b_end = normal == 2 ? top + 1 : CHUNK_SIZE;
+        uint32_t bit_mask = normal == 1 ? layers : ~0u;
+
+        for (int a = a_begin; a < a_end; a++) {
+            for (int b = b_begin; b < b_end; b++) {
+                for (uint32_t bits = faces[face][a][b] & bit_mask; bits;
+                     bits &= bits - 1) {
+                    int pos[3];
+                    face_mask_position(face, a, b, std::countr_zero(bits),
+                                       pos);
+                    Block::BlockType type =
+                        this->get_block(pos[0], pos[1], pos[2]);
+                    add_quad(face, pos[0], pos[1], pos[2], 1, 1,
+                             this->face_attribute(type, face), out);
+                }
+            }
+        }
+    }
+}
 
-            // Position (3 floats)
-            this->vertex_data.push_back(vx);
-            this->vertex_data.push_back(vy);
-            this->vertex_data.push_back(vz);
+// Merges the faces of blocks with bottom <= y <= top. Side faces have V
+// along Y, so rectangles never grow past the section.
+void Chunk::build_greedy_mesh(const FaceMasks &faces, int bottom, int top,
+                              std::vector<Vertex> &out) {
+    // Face attribute + 1 of every visible face in the current slice,
+    // indexed [v][u]; 0 means no face.
+    int mask[CHUNK_SIZE][CHUNK_SIZE];
+    uint32_t layers = (uint32_t)((1ull << (top + 1)) - (1ull << bottom));
 
-            // Texture coordinates (2 floats)
-            this->vertex_data.push_back(this->face_uvs[face][ti]);
-            this->vertex_data.push_back(this->face_uvs[face][ti + 1]);
+    for (int face = 0; face < 6; face++) {
+        int normal = face_axes[face][0];
+        int u_axis = face_axes[face][1];
+        int v_axis = face_axes[face][2];
+        // Left/Right masks are indexed [y][z] = [v][u], the others [u][v]
+        bool transposed = normal == 0;
+        int v_begin = normal == 1 ? 0 : bottom;
+        int v_end = normal == 1 ? CHUNK_SIZE : top + 1;
+
+        uint32_t slices = 0;
+        for (int u = 0; u < CHUNK_SIZE; u++) {
+            for (int v = v_begin; v < v_end; v++)
+                slices |= transposed ? faces[face][v][u] : faces[face][u][v];
+        }
+        if (normal == 1)
+            slices &= layers;
+
+        for (; slices; slices &= slices - 1) {
+            int slice = std::countr_zero(slices);
+            for (int v = v_begin; v < v_end; v++) {
+                for (int u = 0; u < CHUNK_SIZE; u++) {
+                    uint32_t bits = transposed ? faces[face][v][u]
+                                               : faces[face][u][v];
+                    mask[v][u] = 0;
+                    if (!((bits >> slice) & 1))
+                        continue;
+
+                    int pos[3];
+                    pos[normal] = slice;
+                    pos[u_axis] = u;
+                    pos[v_axis] = v;
+                    Block::BlockType type =
+                        this->get_block(pos[0], pos[1], pos[2]);
+                    mask[v][u] = this->face_attribute(type, face) + 1;
+                }
+            }
 
-            // Normal (3 floats)
-            this->vertex_data.push_back(this->face_normals[face][0]);
-            this->vertex_data.push_back(this->face_normals[face][1]);
-            this->vertex_data.push_back(this->face_normals[face][2]);
+            for (int v = v_begin; v < v_end; v++) {
+                for (int u = 0; u < CHUNK_SIZE;) {
+                    int attribute = mask[v][u];
+                    if (!attribute) {
+                        u++;
+                        continue;
+                    }
 
-            // Texture Index (1 int)
-            this->texture_index_data.push_back(texIndex);
-        }
+                    int width = 1;
+                    while (u + width < CHUNK_SIZE &&
+                           mask[v][u + width] == attribute)
+                        width++;
+
+                    int height = 1;
+                    for (; v + height < v_end; height++) {
+                        bool row = true;
+                        for (int k = 0; k < width && row; k++)
+                            row = mask[v + height][u + k] == attribute;
+                        if (!row)
+                            break;
+                    }
 
-        this->index_data.insert(
-            this->index_data.end(),
-            {(unsigned int)(index), (unsigned int)(index + 1),
-             (unsigned int)(index + 2), (unsigned int)(index),
-             (unsigned int)(index + 2), (unsigned int)(index + 3)});
+                    for (int dv = 0; dv < height; dv++) {
+                        for (int du = 0; du < width; du++)
+                            mask[v + dv][u + du] = 0;
+                    }
+
+                    int pos[3];
+                    pos[normal] = slice;
+                    pos[u_axis] = u;
+                    pos[v_axis] = v;
+                    add_quad(face, pos[0], pos[1], pos[2], width, height,
+                             attribute - 1, out);
+                    u += width;
+                }
+            }
+        }
+    }
+}
 
-        index += 4;
+// Emits a quad for `face` covering width x height blocks along the face's
+// U and V axes, starting at block (x, y, z).
+void Chunk::add_quad(int face, int x, int y, int z, int width, int height,
+                     int attribute, std::vector<Vertex> &out) {
+    const int *axes = this->face_axes[face];
+    int extent[3];
+    extent[axes[0]] = 1;
+    extent[axes[1]] = width;
+    extent[axes[2]] = height;
+
+    for (int vertex = 0; vertex < 4; ++vertex) {
+        const int *corner = &this->face_verticies[face][vertex * 3];
+
+        uint32_t px = x + corner[0] * extent[0];
+        uint32_t py = y + corner[1] * extent[1];
+        uint32_t pz = z + corner[2] * extent[2];
+        uint32_t u = corner[axes[1]] * width;
+        uint32_t v = corner[axes[2]] * height;
+
+        out.push_back(
+            {px | py << 6 | pz << 12 | (uint32_t)face << 18,
+             u | v << 6 | (uint32_t)attribute << 12});
     }
 }
 
-void Chunk::modify_block(int x, int y, int z, Block::BlockType type) {
+bool Chunk::modify_block(int x, int y, int z, Block::BlockType type) {
     if (x < 0 || x >= CHUNK_SIZE || y < 0 || y >= CHUNK_SIZE || z < 0 ||
         z >= CHUNK_SIZE)
-        return;
+        return false;
+
+    if (this->get_block(x, y, z) == type)
+        return false;
+
+    this->set_block(x, y, z, type);
+    this->sections[y / SECTION_HEIGHT].compact();
+    this->update_occupancy(x, y, z, type);
+    return true;
+}
+
+// Rebuilds both bitsets from the voxel data, setting whole layers at once
+// for uniform sections.
+void Chunk::rebuild_occupancy() {
+    const BlockRegistry &reg = *this->registry;
+    this->opaque.clear();
+    this->solid.reset();
+
+    for (int section = 0; section < SECTION_COUNT; section++) {
+        const BlockStorage &storage = this->sections[section];
+        int bottom = section * SECTION_HEIGHT;
+        int top = bottom + SECTION_HEIGHT - 1;
+
+        if (storage.is_uniform()) {
+            Block::BlockType type = storage.uniform_value();
+            if (type == Block::BlockType::Air)
+                continue;
+            if (!reg.is_opaque(type) && !this->solid)
+                this->solid = std::make_unique<Occupancy>(this->opaque);
+            if (reg.is_opaque(type))
+                this->opaque.fill_layers(bottom, top);
+            if (this->solid)
+                this->solid->fill_layers(bottom, top);
+            continue;
+        }
 
-    Block &block = this->blocks[x][y][z];
+        for (int x = 0; x < CHUNK_SIZE; x++) {
+            for (int y = bottom; y <= top; y++) {
+                for (int z = 0; z < CHUNK_SIZE; z++) {
+                    Block::BlockType type = this->get_block(x, y, z);
+                    if (type != Block::BlockType::Air)
+                        this->update_occupancy(x, y, z, type);
+                }
+            }
+        }
+    }
+}
+
+void Chunk::update_occupancy(int x, int y, int z, Block::BlockType type) {
+    bool opaque = this->registry->is_opaque(type);
+    bool solid = type != Block::BlockType::Air;
+    // The separate solid bitset only exists once a see-through block does
+    if (solid && !opaque && !this->solid)
+        this->solid = std::make_unique<Occupancy>(this->opaque);
+
+    this->opaque.set(x, y, z, opaque);
+    if (this->solid)
+        this->solid->set(x, y, z, solid);
+}
+
+void Chunk::release_mesh_data() {
+    for (std::vector<Vertex> &mesh : this->vertex_data) {
+        mesh.clear();
+        mesh.shrink_to_fit();
+    }
+}
+
+void Chunk::pin_textures(TextureResidency &textures) {
+    this->textures = &textures;
+    this->pinned_blocks.resize(this->registry->count(), 0);
+    for (const BlockStorage &storage : this->sections) {
+        for (int i = 0; i < storage.palette_size(); i++) {
+            Block::BlockType type = storage.palette_entry(i);
+            if (type == Block::BlockType::Air ||
+                this->pinned_blocks[(int)type])
+                continue;
+            this->pinned_blocks[(int)type] = 1;
+            textures.pin_block(type);
+        }
+    }
+}
 
-    // Remove
-    if (type == Block::BlockType::Air && block.type != Block::BlockType::Air) {
-        block.type = Block::BlockType::Air;
+void Chunk::release_gpu() {
+    if (this->textures) {
+        for (size_t type = 0; type < this->pinned_blocks.size(); type++) {
+            if (this->pinned_blocks[type])
+                this->textures->unpin_block((Block::BlockType)type);
+        }
+        this->pinned_blocks.clear();
+        this->textures = nullptr;
     }
+    if (!this->buffer)
+        return;
+    for (MeshRange &range : this->mesh_ranges) {
+        if (range.capacity)
+            this->buffer->free(range.offset, range.capacity);
+        range = MeshRange();
+    }
+    this->buffer = nullptr;
+}
 
-    // Add
-    if (type == Block::BlockType::Dirt) {
-        block.type = Block::BlockType::Dirt;
-        block.top = Block::BlockTexture::GRASS_TOP;
-        block.bottom = Block::BlockTexture::GRASS_BOTTOM;
-        block.side = Block::BlockTexture::GRASS_SIDE;
+void Chunk::upload_to_gpu(ChunkBuffer &buffer) {
+    static_assert(sizeof(Vertex) == ChunkBuffer::VERTEX_BYTES);
+    this->buffer = &buffer;
+    for (int section = 0; section < SECTION_COUNT; section++) {
+        if (!(this->upload_sections & (1 << section)))
+            continue;
+        int faces = this->section_faces[section];
+        MeshRange &range = this->mesh_ranges[section];
+        if (faces > range.capacity) {
+            if (range.capacity)
+                buffer.free(range.offset, range.capacity);
+            range.capacity = faces + faces / 4 + MESH_RANGE_SLACK;
+            range.offset = buffer.allocate(range.capacity);
+        }
+        if (faces)
+            buffer.upload(range.offset, this->vertex_data[section].data(),
+                          faces);
+        range.quads = faces;
+        std::copy(std::begin(this->section_face_quads[section]),
+                  std::end(this->section_face_quads[section]),
+                  range.face_quads);
     }
-    this->build_mesh();
-    this->upload_to_gpu();
+    this->upload_sections = 0;
+    this->draw_min_y = this->mesh_min_y;
+    this->draw_max_y = this->mesh_max_y;
+    std::memcpy(this->draw_occluders, this->mesh_occluders,
+                sizeof(this->draw_occluders));
+    std::memcpy(this->draw_connectivity, this->mesh_connectivity,
+                sizeof(this->draw_connectivity));
 }
 
-void Chunk::upload_to_gpu() {
-    glBindVertexArray(this->vao);
-    glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
-    glBufferData(GL_ARRAY_BUFFER, this->vertex_data.size() * sizeof(float),
-                 this->vertex_data.data(), GL_DYNAMIC_DRAW);
-
-    // Vertex positions (attribute 0)
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-                          (void *)0);
-
-    // Texture coordinates (attribute 1)
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-                          (void *)(3 * sizeof(float)));
-
-    // Normal vectors (attribute 2)
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float),
-                          (void *)(5 * sizeof(float)));
-
-    // Type data (attribute 3)
-    glBindBuffer(GL_ARRAY_BUFFER, this->vbo_type);
-    glBufferData(GL_ARRAY_BUFFER, this->texture_index_data.size() * sizeof(int),
-                 this->texture_index_data.data(), GL_DYNAMIC_DRAW);
-
-    glEnableVertexAttribArray(3);
-    glVertexAttribIPointer(3, 1, GL_INT, 0, (void *)0);
-
-    // Element indices
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-                 this->index_data.size() * sizeof(unsigned int),
-                 this->index_data.data(), GL_DYNAMIC_DRAW);
+uint16_t Chunk::section_connectivity(int section) const {
+    int bottom = section * SECTION_HEIGHT;
+    uint32_t layers = ((1u << SECTION_HEIGHT) - 1) << bottom;
+    uint32_t any = 0, all = layers;
+    for (int x = 0; x < CHUNK_SIZE; x++) {
+        for (int z = 0; z < CHUNK_SIZE; z++) {
+            any |= this->opaque.cols_y[x][z] & layers;
+            all &= this->opaque.cols_y[x][z];
+        }
+    }
+    if (!any)
+        return ALL_FACE_PAIRS;
+    if (all == layers)
+        return 0;
+
+    // Cells are x | z << 5 | (y - bottom) << 10, marked once queued
+    static_assert(CHUNK_SIZE == 32 && SECTION_HEIGHT == 8);
+    uint32_t seen[SECTION_HEIGHT][CHUNK_SIZE] = {};
+    for (int x = 0; x < CHUNK_SIZE; x++) {
+        for (int z = 0; z < CHUNK_SIZE; z++) {
+            uint32_t column = this->opaque.cols_y[x][z] >> bottom;
+            for (int y = 0; y < SECTION_HEIGHT; y++)
+                seen[y][z] |= (column >> y & 1) << x;
+        }
+    }
+
+    uint16_t connectivity = 0;
+    std::vector<uint16_t> stack;
+    for (int start = 0; start < SECTION_VOLUME; start++) {
+        int sx = start & 31, sz = start >> 5 & 31, sy = start >> 10;
+        if (seen[sy][sz] >> sx & 1)
+            continue;
+        seen[sy][sz] |= 1u << sx;
+        stack.push_back(start);
+
+        uint8_t touched = 0;
+        while (!stack.empty()) {
+            int cell = stack.back();
+            stack.pop_back();
+            int x = cell & 31, z = cell >> 5 & 31, y = cell >> 10;
+            touched |= (y == SECTION_HEIGHT - 1) << 0 | (y == 0) << 1 |
+                       (z == CHUNK_SIZE - 1) << 2 | (z == 0) << 3 |
+                       (x == 0) << 4 | (x == CHUNK_SIZE - 1) << 5;
+            for (const int *offset : face_offsets) {
+                int nx = x + offset[0], ny = y + offset[1], nz = z + offset[2];
+                if (nx < 0 || nx >= CHUNK_SIZE || ny < 0 ||
+                    ny >= SECTION_HEIGHT || nz < 0 || nz >= CHUNK_SIZE)
+                    continue;
+                if (seen[ny][nz] >> nx & 1)
+                    continue;
+                seen[ny][nz] |= 1u << nx;
+                stack.push_back(nx | nz << 5 | ny << 10);
+            }
+        }
+
+        for (int a = 0; a < 6; a++) {
+            for (int b = a + 1; b < 6; b++) {
+                if ((touched >> a & 1) && (touched >> b & 1))
+                    connectivity |= 1 << face_pair_bit(a, b);
+            }
+        }
+        if (connectivity == ALL_FACE_PAIRS)
+            break;
+    }
+    return connectivity;
 }
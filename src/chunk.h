@@ -2,26 +2,87 @@
 #pragma once
 #include "FastNoiseLite.h"
 #include "block.h"
+#include "block_registry.h"
+#include "block_storage.h"
+#include "chunk_buffer.h"
+#include "occupancy.h"
+#include "texture_residency.h"
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <vector>
 #include <memory>
+#include <random>
 
 struct Chunk {
     static constexpr int CHUNK_SIZE = 32;
+    static constexpr int CHUNK_VOLUME = CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE;
+    // Footprint of the old Block[32][32][32] layout (type + three face
+    // textures per voxel), kept for the debug menu comparison.
+    static constexpr size_t UNPACKED_BYTES = CHUNK_VOLUME * 16;
 
-    Block blocks[CHUNK_SIZE][CHUNK_SIZE][CHUNK_SIZE];
-    uint vao, vbo, vbo_type, ebo;
-    std::vector<float> vertex_data;
-    std::vector<unsigned int> index_data;
-    std::vector<int> texture_index_data;
+    // Voxels are stored in 32x8x32 horizontal sections, bottom to top. A
+    // section that holds a single block type is stored as that one value.
+    static constexpr int SECTION_HEIGHT = 8;
+    static constexpr int SECTION_COUNT = CHUNK_SIZE / SECTION_HEIGHT;
+    static constexpr int SECTION_VOLUME =
+        CHUNK_SIZE * SECTION_HEIGHT * CHUNK_SIZE;
+    enum class SectionState { Empty, Uniform, Mixed };
+
+    // Mesh vertex packed into two words, decoded in vertex.glsl:
+    //   position: x | y << 6 | z << 12 | face << 18
+    //   surface:  u | v << 6 | face attribute << 12 (see BlockRegistry)
+    // Corners and quad extents are at most 32, so 6 bits per field suffice.
+    struct Vertex {
+        uint32_t position;
+        uint32_t surface;
+    };
+    // The previous layout: 8 floats (position, uv, normal) plus one int
+    static constexpr size_t UNPACKED_VERTEX_BYTES = 8 * sizeof(float) + 4;
+    static_assert(BlockRegistry::ANIMATED_BIT < (1 << 20));
+
+    // Each section's faces occupy their own range of the ChunkBuffer,
+    // measured in quads, with spare room so an edit can rewrite just that
+    // range in place. Within a range the faces are grouped by direction,
+    // in face order, so faces pointing away from the camera are skipped a
+    // whole group at a time.
+    struct MeshRange {
+        int offset = 0;
+        int capacity = 0;
+        int quads = 0;
+        int face_quads[6] = {};
+    };
+    static constexpr uint8_t ALL_SECTIONS = (1 << SECTION_COUNT) - 1;
+    static constexpr int MESH_RANGE_SLACK = 16;
+
+    std::vector<BlockStorage> sections;
+    // Holds the mesh ranges once uploaded, nullptr before
+    ChunkBuffer *buffer = nullptr;
+    // Holds the textures of the block types with a pinned_blocks entry,
+    // from the first pin_textures until release_gpu; nullptr before
+    TextureResidency *textures = nullptr;
+    std::vector<uint8_t> pinned_blocks;
+    // Vertices of each section's faces, i.e. faces of the blocks in it
+    std::vector<Vertex> vertex_data[SECTION_COUNT];
+    MeshRange mesh_ranges[SECTION_COUNT];
     glm::vec2 chunk_position;
+    const BlockRegistry *registry;
 
     std::unique_ptr<FastNoiseLite> noise;
 
-    static constexpr float face_verticies[6][12] = {
+    // Opaque blocks, and all non-air blocks when they differ. `solid` is
+    // only allocated once the chunk holds a see-through block such as
+    // leaves; until then solid_mask() is the opaque bitset.
+    static_assert(CHUNK_SIZE == Occupancy::SIZE);
+    Occupancy opaque;
+    std::unique_ptr<Occupancy> solid;
+    // Visible faces per face direction, laid out like the Occupancy view
+    // whose words run along the face normal: cols_y for Top/Bottom, rows_z
+    // for Front/Back, rows_x for Left/Right.
+    using FaceMasks = uint32_t[6][CHUNK_SIZE][CHUNK_SIZE];
+
+    static constexpr int face_verticies[6][12] = {
         {0, 1, 0, 1, 1, 0, 1, 1, 1, 0, 1, 1}, // Top (y+1)
         {0, 0, 0, 0, 0, 1, 1, 0, 1, 1, 0, 0}, // Bottom (y)
         {0, 0, 1, 0, 1, 1, 1, 1, 1, 1, 0, 1}, // Front (z+1)
@@ -30,35 +91,178 @@ struct Chunk {
         {1, 0, 0, 1, 0, 1, 1, 1, 1, 1, 1, 0}  // Right (x+1)
     };
 
-    static constexpr float face_normals[6][3] = {
-        {0, 1, 0},  // Top
-        {0, -1, 0}, // Bottom
-        {0, 0, 1},  // Front
-        {0, 0, -1}, // Back
-        {-1, 0, 0}, // Left
-        {1, 0, 0}   // Right
+    // Normal axis and the in-plane axes U and V follow (0 = x, 1 = y,
+    // 2 = z). A vertex's texture coordinate is its corner offset along U
+    // and V, so a quad spanning several blocks tiles with GL_REPEAT.
+    static constexpr int face_axes[6][3] = {
+        {1, 0, 2}, // Top
+        {1, 0, 2}, // Bottom
+        {2, 0, 1}, // Front
+        {2, 0, 1}, // Back
+        {0, 2, 1}, // Left
+        {0, 2, 1}  // Right
     };
 
-    static constexpr float face_uvs[6][8] = {
-        {0, 0, 1, 0, 1, 1, 0, 1}, // Top face
-        {0, 0, 0, 1, 1, 1, 1, 0}, // Bottom face
-        {0, 0, 0, 1, 1, 1, 1, 0}, // Front face
-        {0, 0, 1, 0, 1, 1, 0, 1}, // Back face
-        {0, 0, 0, 1, 1, 1, 1, 0}, // Left face
-        {0, 0, 1, 0, 1, 1, 0, 1}  // Right face
-    };
+    // Faces come in opposite pairs, so face ^ 1 is the opposite face
+    static constexpr int face_offsets[6][3] = {
+        {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}, {-1, 0, 0}, {1, 0, 0}};
+    // Index of the unordered pair {a, b}, a != b, among the 15 pairs
+    static constexpr int face_pair_bit(int a, int b) {
+        if (a > b)
+            std::swap(a, b);
+        return a * (11 - a) / 2 + b - a - 1;
+    }
 
     enum class Biome { Plains, Forest, Desert, Ocean };
 
-    Chunk(int x, int z);
+    // Horizontal neighbors passed to build_mesh, nullptr if not loaded
+    enum Neighbor { LEFT = 0, RIGHT = 1, BACK = 2, FRONT = 3 };
+
+    // Naive emits one quad per visible face; Greedy merges coplanar faces
+    // with the same face attribute into rectangles.
+    enum class MeshMode { Naive, Greedy };
+
+    // Queued: waiting for or running generate_terrain on a worker.
+    // Generated: voxels final, no mesh on the GPU yet.
+    // Meshed: vertices built, waiting for upload on the main thread.
+    // Uploaded: drawable; a re-mesh goes through Meshed again.
+    enum class State { Queued, Generated, Meshed, Uploaded };
+
+    // Owned by the main thread. While `in_flight` a worker is writing this
+    // chunk; `readers` counts mesh jobs reading it as a neighbor. Edits and
+    // unloading wait until both are clear.
+    State state = State::Queued;
+    bool in_flight = false;
+    int readers = 0;
+    // glfwGetTime() when ChunkManager asked for this chunk, and whether
+    // that request was served from the ChunkCache
+    double load_requested = 0.0;
+    bool cache_hit = false;
+
+    // Bit per section whose mesh is out of date; ChunkManager rebuilds
+    // them once the neighbors are known.
+    uint8_t dirty_sections = 0;
+    // Sections rebuilt since the last upload_to_gpu
+    uint8_t upload_sections = 0;
+    int section_faces[SECTION_COUNT] = {};
+    int section_face_quads[SECTION_COUNT][6] = {};
+    // Y extent of the blocks in the last built mesh, and of the uploaded
+    // mesh; the uploaded one bounds the chunk for culling. min > max when
+    // the chunk is empty.
+    int mesh_min_y = CHUNK_SIZE, mesh_max_y = -1;
+    int draw_min_y = CHUNK_SIZE, draw_max_y = -1;
+    // Height of the opaque blocks filling every column of each
+    // OCCLUDER_CELL square from the bottom up, used as occlusion boxes;
+    // built with the mesh and published with it like the Y extent.
+    static constexpr int OCCLUDER_CELL = 8;
+    static constexpr int OCCLUDER_CELLS = CHUNK_SIZE / OCCLUDER_CELL;
+    uint8_t mesh_occluders[OCCLUDER_CELLS][OCCLUDER_CELLS] = {};
+    uint8_t draw_occluders[OCCLUDER_CELLS][OCCLUDER_CELLS] = {};
+    // Which pairs of a section's faces are joined through non-opaque
+    // blocks, one bit per pair (see face_pair_bit); built and published
+    // with the mesh. Sections never meshed count as open.
+    static constexpr uint16_t ALL_FACE_PAIRS = (1 << 15) - 1;
+    uint16_t mesh_connectivity[SECTION_COUNT];
+    uint16_t draw_connectivity[SECTION_COUNT];
+    int face_count = 0;
+    // Border faces hidden by a neighbor chunk in the last build_mesh
+    int border_faces_culled = 0;
+
+    // Constructs an empty chunk; terrain comes from generate_terrain and
+    // GPU ranges from the first upload_to_gpu.
+    Chunk(int x, int z, const BlockRegistry *registry);
     ~Chunk();
 
+    // Index of (x, y, z) inside its section
+    static int block_index(int x, int y, int z) {
+        return (x * SECTION_HEIGHT + y % SECTION_HEIGHT) * CHUNK_SIZE + z;
+    }
+    Block::BlockType get_block(int x, int y, int z) const {
+        return this->sections[y / SECTION_HEIGHT].get(block_index(x, y, z));
+    }
+    void set_block(int x, int y, int z, Block::BlockType type) {
+        this->sections[y / SECTION_HEIGHT].set(block_index(x, y, z), type);
+    }
+    SectionState section_state(int section) const {
+        const BlockStorage &storage = this->sections[section];
+        if (!storage.is_uniform())
+            return SectionState::Mixed;
+        return storage.uniform_value() == Block::BlockType::Air
+                   ? SectionState::Empty
+                   : SectionState::Uniform;
+    }
+    const Occupancy &solid_mask() const {
+        return this->solid ? *this->solid : this->opaque;
+    }
+    bool is_solid(int x, int y, int z) const {
+        return this->solid_mask().get(x, y, z);
+    }
+    size_t mesh_memory_usage() const {
+        size_t bytes = 0;
+        for (const std::vector<Vertex> &mesh : this->vertex_data)
+            bytes += mesh.capacity() * sizeof(Vertex);
+        return bytes;
+    }
+    size_t gpu_memory_usage() const {
+        size_t quads = 0;
+        for (const MeshRange &range : this->mesh_ranges)
+            quads += range.capacity;
+        return quads * ChunkBuffer::QUAD_BYTES;
+    }
+    // Everything an evicted chunk keeps alive
+    size_t cache_memory_usage() const {
+        return sizeof(*this) + this->memory_usage() +
+               (this->solid ? sizeof(Occupancy) : 0) +
+               this->mesh_memory_usage() + this->gpu_memory_usage();
+    }
+    size_t memory_usage() const {
+        size_t bytes = 0;
+        for (const BlockStorage &section : this->sections)
+            bytes += section.memory_usage();
+        return bytes;
+    }
+
     void generate_terrain();
-    void generate_tree(int x, int y, int z);
-    void render();
-    void build_mesh();
-    void add_block_to_mesh(int x, int y, int z, int &index,
-                           const bool occluded[6]);
-    void modify_block(int x, int y, int z, Block::BlockType type);
-    void upload_to_gpu();
+    void generate_tree(int x, int y, int z, std::minstd_rand &rng);
+    // Queues draws of the face groups of the given sections that can face
+    // `camera`, given relative to the chunk origin; returns the quads drawn
+    int render(const glm::vec3 &camera, uint8_t sections = ALL_SECTIONS);
+    int uploaded_quads(uint8_t sections = ALL_SECTIONS) const;
+    // Re-meshes the given sections
+    void build_mesh(const Chunk *const neighbors[4], MeshMode mode,
+                    uint8_t sections);
+    void compute_face_masks(const Chunk *const neighbors[4],
+                            FaceMasks &faces);
+    void build_section_mesh(const FaceMasks &faces, MeshMode mode,
+                            int section);
+    void build_naive_mesh(const FaceMasks &faces, int bottom, int top,
+                          std::vector<Vertex> &out);
+    void build_greedy_mesh(const FaceMasks &faces, int bottom, int top,
+                           std::vector<Vertex> &out);
+    void add_quad(int face, int x, int y, int z, int width, int height,
+                  int attribute, std::vector<Vertex> &out);
+    // Flood-fills the section's non-opaque blocks and returns the face
+    // pairs that some connected region touches
+    uint16_t section_connectivity(int section) const;
+    // Face attribute with the texture's resident layer, see BlockRegistry
+    int face_attribute(Block::BlockType type, int face) const {
+        int attribute = this->registry->face_attribute(type, face);
+        return this->textures ? this->textures->face_attribute(attribute)
+                              : attribute;
+    }
+    // Pins the textures of the block types in the sections' palettes that
+    // are not pinned yet; called on the main thread before each mesh build
+    void pin_textures(TextureResidency &textures);
+    // Returns true if the block changed; the caller schedules the re-mesh.
+    bool modify_block(int x, int y, int z, Block::BlockType type);
+    void rebuild_occupancy();
+    void update_occupancy(int x, int y, int z, Block::BlockType type);
+    // Copies the rebuilt sections into `buffer`, moving a section to a
+    // larger range when it outgrew its own
+    void upload_to_gpu(ChunkBuffer &buffer);
+    // Drops the CPU copy of the mesh once it lives on the GPU
+    void release_mesh_data();
+    // Frees the GPU ranges and unpins the textures; the next mesh build
+    // pins them again and upload_to_gpu allocates new ranges
+    void release_gpu();
 };
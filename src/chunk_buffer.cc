@@ -0,0 +1,140 @@
+// chunk_buffer.cc
+#include "chunk_buffer.h"
+#include <algorithm>
+
+ChunkBuffer::ChunkBuffer() : ranges(INITIAL_QUADS) {
+    this->indirect = GLAD_GL_VERSION_4_3;
+    glGenVertexArrays(1, &this->vao);
+    glGenBuffers(1, &this->vbo);
+    glGenBuffers(1, &this->origin_vbo);
+    glGenBuffers(1, &this->command_buffer);
+
+    glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+    glBufferData(GL_ARRAY_BUFFER, INITIAL_QUADS * QUAD_BYTES, nullptr,
+                 GL_DYNAMIC_DRAW);
+    glBindVertexArray(this->vao);
+    this->bind_vertices();
+
+    // Chunk origin (attribute 1), one per draw command
+    if (this->indirect) {
+        glBindBuffer(GL_ARRAY_BUFFER, this->origin_vbo);
+        glEnableVertexAttribArray(1);
+        glVertexAttribIPointer(1, 2, GL_INT, sizeof(glm::ivec2), (void *)0);
+        glVertexAttribDivisor(1, 1);
+    }
+}
+
+ChunkBuffer::~ChunkBuffer() {
+    glDeleteVertexArrays(1, &this->vao);
+    glDeleteBuffers(1, &this->vbo);
+    glDeleteBuffers(1, &this->origin_vbo);
+    glDeleteBuffers(1, &this->command_buffer);
+}
+
+// Packed vertex (attribute 0), two unsigned ints; expects the VAO bound
+void ChunkBuffer::bind_vertices() {
+    glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+    glEnableVertexAttribArray(0);
+    glVertexAttribIPointer(0, 2, GL_UNSIGNED_INT, VERTEX_BYTES, (void *)0);
+}
+
+int ChunkBuffer::allocate(int quads) {
+    int offset = this->ranges.allocate(quads);
+    if (offset >= 0)
+        return offset;
+
+    // Copy everything into a buffer twice the size; ranges keep their
+    // offsets, so chunks are unaffected
+    int old_quads = this->ranges.capacity();
+    int new_quads = std::max(old_quads * 2, old_quads + quads);
+    uint grown;
+    glGenBuffers(1, &grown);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+    glBufferData(GL_COPY_WRITE_BUFFER, new_quads * QUAD_BYTES, nullptr,
+                 GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_COPY_READ_BUFFER, this->vbo);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                        old_quads * QUAD_BYTES);
+    glDeleteBuffers(1, &this->vbo);
+    this->vbo = grown;
+    glBindVertexArray(this->vao);
+    this->bind_vertices();
+
+    this->ranges.grow(new_quads);
+    return this->ranges.allocate(quads);
+}
+
+void ChunkBuffer::free(int offset, int quads) {
+    this->ranges.free(offset, quads);
+}
+
+void ChunkBuffer::upload(int offset, const void *vertices, int quads) {
+    glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, offset * QUAD_BYTES, quads * QUAD_BYTES,
+                    vertices);
+}
+
+void ChunkBuffer::draw(glm::ivec2 chunk, int first, int quads) {
+    if (this->origins.empty() || this->origins.back().x != chunk.x ||
+        this->origins.back().y != chunk.y)
+        this->origins.push_back(chunk);
+    this->commands.push_back({(GLuint)quads * 6, 1, 0, first * 4,
+                              (GLuint)this->origins.size() - 1});
+    this->largest_draw = std::max(this->largest_draw, quads);
+}
+
+void ChunkBuffer::flush() {
+    this->draw_calls = this->vao_binds = 0;
+    if (this->commands.empty())
+        return;
+
+    // Every draw's indices start at 0 from its base vertex, so the largest
+    // draw decides the index type
+    glBindVertexArray(this->vao);
+    this->vao_binds++;
+    this->quad_indices.bind(this->largest_draw);
+    GLenum index_type = QuadIndices::index_type(this->largest_draw);
+
+    if (this->indirect) {
+        glBindBuffer(GL_ARRAY_BUFFER, this->origin_vbo);
+        glBufferData(GL_ARRAY_BUFFER,
+                     this->origins.size() * sizeof(glm::ivec2),
+                     this->origins.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->command_buffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER,
+                     this->commands.size() * sizeof(DrawCommand),
+                     this->commands.data(), GL_STREAM_DRAW);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, index_type, (void *)0,
+                                    (GLsizei)this->commands.size(), 0);
+        this->draw_calls++;
+    } else {
+        this->counts.clear();
+        this->base_vertices.clear();
+        for (const DrawCommand &command : this->commands) {
+            this->counts.push_back(command.count);
+            this->base_vertices.push_back(command.base_vertex);
+        }
+        this->index_offsets.assign(this->commands.size(), nullptr);
+
+        size_t first = 0;
+        while (first < this->commands.size()) {
+            GLuint origin = this->commands[first].base_instance;
+            size_t end = first;
+            while (end < this->commands.size() &&
+                   this->commands[end].base_instance == origin)
+                end++;
+            glVertexAttribI2i(1, this->origins[origin].x,
+                              this->origins[origin].y);
+            glMultiDrawElementsBaseVertex(
+                GL_TRIANGLES, &this->counts[first], index_type,
+                &this->index_offsets[first], (GLsizei)(end - first),
+                &this->base_vertices[first]);
+            this->draw_calls++;
+            first = end;
+        }
+    }
+
+    this->commands.clear();
+    this->origins.clear();
+    this->largest_draw = 0;
+}
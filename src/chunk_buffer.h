@@ -0,0 +1,74 @@
+// chunk_buffer.h
+#pragma once
+#include "glad.h"
+#include "quad_indices.h"
+#include "range_allocator.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+// One vertex buffer holding every chunk mesh, carved into quad ranges by a
+// RangeAllocator, with one VAO to draw them all. Chunks queue their draws
+// during a frame and flush() issues them: with GL 4.3 as a single
+// glMultiDrawElementsIndirect whose base instance picks each chunk's
+// origin from an instanced attribute, otherwise as one
+// glMultiDrawElementsBaseVertex per chunk with the origin set as a constant
+// attribute value. Both feed aChunk in vertex.glsl.
+struct ChunkBuffer {
+    // A packed Chunk::Vertex; checked in chunk.cc
+    static constexpr size_t VERTEX_BYTES = 8;
+    static constexpr size_t QUAD_BYTES = 4 * VERTEX_BYTES;
+    // 8 MB to start; the buffer doubles when full
+    static constexpr int INITIAL_QUADS = 1 << 18;
+
+    bool indirect = false;
+    // GL calls made by the last flush
+    int draw_calls = 0;
+    int vao_binds = 0;
+
+    ChunkBuffer();
+    ~ChunkBuffer();
+    ChunkBuffer(const ChunkBuffer &) = delete;
+    ChunkBuffer &operator=(const ChunkBuffer &) = delete;
+
+    // Returns the first quad of a new range of `quads` quads
+    int allocate(int quads);
+    void free(int offset, int quads);
+    void upload(int offset, const void *vertices, int quads);
+
+    // Queues `quads` quads from `first` for the chunk at `chunk`
+    void draw(glm::ivec2 chunk, int first, int quads);
+    void flush();
+
+    size_t memory_usage() const {
+        return (size_t)this->ranges.capacity() * QUAD_BYTES;
+    }
+    size_t used_bytes() const {
+        return (size_t)this->ranges.used() * QUAD_BYTES;
+    }
+    int free_range_count() const { return this->ranges.free_range_count(); }
+
+  private:
+    // Laid out as GL's DrawElementsIndirectCommand
+    struct DrawCommand {
+        GLuint count;
+        GLuint instance_count;
+        GLuint first_index;
+        GLint base_vertex;
+        GLuint base_instance;
+    };
+
+    uint vao = 0, vbo = 0, origin_vbo = 0, command_buffer = 0;
+    QuadIndices quad_indices;
+    RangeAllocator ranges;
+
+    // Draws queued this frame; base_instance indexes origins
+    std::vector<DrawCommand> commands;
+    std::vector<glm::ivec2> origins;
+    int largest_draw = 0;
+    // Per-draw arrays for glMultiDrawElementsBaseVertex
+    std::vector<GLsizei> counts;
+    std::vector<const void *> index_offsets;
+    std::vector<GLint> base_vertices;
+
+    void bind_vertices();
+};
@@ -0,0 +1,71 @@
+// chunk_cache.h
+#pragma once
+#include "chunk_table.h"
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+// Bounded LRU cache of values evicted from a ChunkTable, keyed by the same
+// packed coordinates. A lookup takes the value back out, so the entries are
+// ordered by eviction time and the oldest are dropped once the total size
+// passes the byte budget.
+template <typename T> struct ChunkCache {
+    size_t budget_bytes;
+    int hits = 0;
+    int misses = 0;
+
+    explicit ChunkCache(size_t budget_bytes) : budget_bytes(budget_bytes) {}
+
+    // Removes and returns the value for (x, z), or nullptr on a miss
+    std::unique_ptr<T> take(int x, int z) {
+        auto found = this->index.find(ChunkTable<T>::pack(x, z));
+        if (found == this->index.end()) {
+            this->misses++;
+            return nullptr;
+        }
+        this->hits++;
+        std::unique_ptr<T> value = std::move(found->second->value);
+        this->remove(found->second);
+        return value;
+    }
+
+    // Inserts `value` as the most recently used entry, dropping the least
+    // recently used ones that no longer fit
+    void put(int x, int z, std::unique_ptr<T> value, size_t bytes) {
+        uint64_t key = ChunkTable<T>::pack(x, z);
+        auto found = this->index.find(key);
+        if (found != this->index.end())
+            this->remove(found->second);
+
+        this->entries.push_front({key, std::move(value), bytes});
+        this->index[key] = this->entries.begin();
+        this->total_bytes += bytes;
+        while (this->total_bytes > this->budget_bytes && !this->entries.empty())
+            this->remove(std::prev(this->entries.end()));
+    }
+
+    size_t size() const { return this->entries.size(); }
+    size_t memory_usage() const { return this->total_bytes; }
+    float hit_rate() const {
+        int lookups = this->hits + this->misses;
+        return lookups ? (float)this->hits / lookups : 0.0f;
+    }
+
+  private:
+    struct Entry {
+        uint64_t key;
+        std::unique_ptr<T> value;
+        size_t bytes;
+    };
+    // Most recently evicted first
+    std::list<Entry> entries;
+    std::unordered_map<uint64_t, typename std::list<Entry>::iterator> index;
+    size_t total_bytes = 0;
+
+    void remove(typename std::list<Entry>::iterator entry) {
+        this->total_bytes -= entry->bytes;
+        this->index.erase(entry->key);
+        this->entries.erase(entry);
+    }
+};
@@ -0,0 +1,174 @@
+// chunk_table.h
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Open-addressing hash table keyed by packed (x, z) chunk coordinates.
+// Linear probing with backward-shift deletion, so lookups, presence checks
+// and unload scans never allocate and never leave tombstones behind.
+template <typename T> struct ChunkTable {
+    struct Slot {
+        uint64_t key = 0;
+        std::unique_ptr<T> value;
+    };
+
+    // Walks occupied slots only; S is Slot or const Slot.
+    template <typename S> struct BasicIterator {
+        S *slot;
+        S *end;
+
+        BasicIterator(S *slot, S *end) : slot(slot), end(end) {
+            this->skip();
+        }
+        S &operator*() const { return *slot; }
+        BasicIterator &operator++() {
+            slot++;
+            this->skip();
+            return *this;
+        }
+        bool operator!=(const BasicIterator &other) const {
+            return slot != other.slot;
+        }
+
+      private:
+        void skip() {
+            while (slot != end && !slot->value)
+                slot++;
+        }
+    };
+    using Iterator = BasicIterator<Slot>;
+    using ConstIterator = BasicIterator<const Slot>;
+
+    static uint64_t pack(int x, int z) {
+        return (uint64_t)(uint32_t)x << 32 | (uint32_t)z;
+    }
+    static int unpack_x(uint64_t key) { return (int)(uint32_t)(key >> 32); }
+    static int unpack_z(uint64_t key) { return (int)(uint32_t)key; }
+
+    ChunkTable() { this->slots.resize(16); }
+
+    size_t size() const { return this->count; }
+    bool empty() const { return this->count == 0; }
+
+    T *find(int x, int z) const {
+        uint64_t key = pack(x, z);
+        for (size_t i = this->home(key);; i = (i + 1) & this->mask()) {
+            const Slot &slot = this->slots[i];
+            if (!slot.value)
+                return nullptr;
+            if (slot.key == key)
+                return slot.value.get();
+        }
+    }
+    bool contains(int x, int z) const { return this->find(x, z) != nullptr; }
+
+    T *insert(int x, int z, std::unique_ptr<T> value) {
+        if ((this->count + 1) * 2 > this->slots.size())
+            this->rehash(this->slots.size() * 2);
+
+        uint64_t key = pack(x, z);
+        size_t i = this->home(key);
+        while (this->slots[i].value && this->slots[i].key != key)
+            i = (i + 1) & this->mask();
+
+        if (!this->slots[i].value)
+            this->count++;
+        this->slots[i].key = key;
+        this->slots[i].value = std::move(value);
+        return this->slots[i].value.get();
+    }
+
+    // Removes the entry for (x, z) and hands back its value, or nullptr.
+    std::unique_ptr<T> take(int x, int z) {
+        uint64_t key = pack(x, z);
+        for (size_t i = this->home(key);; i = (i + 1) & this->mask()) {
+            Slot &slot = this->slots[i];
+            if (!slot.value)
+                return nullptr;
+            if (slot.key == key) {
+                std::unique_ptr<T> value = std::move(slot.value);
+                this->erase_at(i);
+                return value;
+            }
+        }
+    }
+
+    // Removes every entry for which pred(x, z, value) returns true.
+    template <typename Pred> void erase_if(Pred pred) {
+        for (size_t i = 0; i < this->slots.size();) {
+            Slot &slot = this->slots[i];
+            if (slot.value && pred(unpack_x(slot.key), unpack_z(slot.key),
+                                   *slot.value)) {
+                // The next entry of the probe run may have shifted into i.
+                this->erase_at(i);
+            } else {
+                i++;
+            }
+        }
+    }
+
+    void reserve(size_t entries) {
+        size_t capacity = this->slots.size();
+        while (capacity < entries * 2)
+            capacity *= 2;
+        if (capacity != this->slots.size())
+            this->rehash(capacity);
+    }
+
+    Iterator begin() {
+        Slot *end = this->slots.data() + this->slots.size();
+        return Iterator(this->slots.data(), end);
+    }
+    Iterator end() {
+        Slot *end = this->slots.data() + this->slots.size();
+        return Iterator(end, end);
+    }
+    ConstIterator begin() const {
+        const Slot *end = this->slots.data() + this->slots.size();
+        return ConstIterator(this->slots.data(), end);
+    }
+    ConstIterator end() const {
+        const Slot *end = this->slots.data() + this->slots.size();
+        return ConstIterator(end, end);
+    }
+
+  private:
+    std::vector<Slot> slots;
+    size_t count = 0;
+
+    size_t mask() const { return this->slots.size() - 1; }
+    size_t home(uint64_t key) const {
+        return (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & this->mask();
+    }
+
+    void erase_at(size_t hole) {
+        this->slots[hole].value.reset();
+        this->count--;
+
+        for (size_t i = (hole + 1) & this->mask(); this->slots[i].value;
+             i = (i + 1) & this->mask()) {
+            // An entry whose home lies cyclically in (hole, i] is still
+            // reachable without crossing the hole and stays put.
+            size_t home = this->home(this->slots[i].key);
+            bool reachable = hole <= i ? (hole < home && home <= i)
+                                       : (hole < home || home <= i);
+            if (reachable)
+                continue;
+            this->slots[hole] = std::move(this->slots[i]);
+            hole = i;
+        }
+    }
+
+    void rehash(size_t capacity) {
+        std::vector<Slot> old = std::move(this->slots);
+        this->slots.clear();
+        this->slots.resize(capacity);
+        this->count = 0;
+        for (Slot &slot : old) {
+            if (slot.value)
+                this->insert(unpack_x(slot.key), unpack_z(slot.key),
+                             std::move(slot.value));
+        }
+    }
+};
@@ -3,79 +3,685 @@
 #include "glad.h"
 #include "shader.hpp"
 #include "chunk.h"
+#include "chunk_cache.h"
+#include "chunk_table.h"
+#include "frustum.h"
+#include "latency_histogram.h"
+#include "occlusion.h"
+#include "worker_pool.h"
 #include <glm/fwd.hpp>
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <deque>
 #include <memory>
-#include <string>
-#include <unordered_map>
+#include <vector>
 
 struct ChunkManager {
-    std::unordered_map<std::string, std::unique_ptr<Chunk>> chunks;
+    // A block edit, kept until its chunk is free of workers (deferred) and
+    // then until the re-meshed chunk is uploaded (pending)
+    struct BlockEdit {
+        glm::ivec2 chunk;
+        glm::ivec3 block;
+        Block::BlockType type;
+        double start;
+    };
+    // A meshed chunk waiting for upload, with the time its mesh job was
+    // dispatched
+    struct MeshedChunk {
+        glm::ivec2 chunk;
+        double dispatched;
+    };
+
+    // Every chunk mesh; declared first so it outlives the chunks, which
+    // free their ranges in it when destroyed
+    ChunkBuffer chunk_buffer;
+    // Block textures of the loaded chunks; also outlives them
+    TextureResidency textures;
+    ChunkTable<Chunk> chunks;
+    std::vector<glm::ivec2> dirty_chunks;
+    std::deque<MeshedChunk> upload_queue;
     Shader *shader;
+    const BlockRegistry *registry;
     int render_distance = 12;
+    Chunk::MeshMode mesh_mode = Chunk::MeshMode::Naive;
+    // Keep each chunk's CPU-side vertices after upload instead of freeing
+    bool keep_mesh_data = false;
+    // Main-thread time per frame spent uploading meshes; at least one
+    // upload always goes through
+    double upload_budget_ms = 2.0;
+
+    // Mesh build timings since the mesher was last switched
+    double mesh_time_ms = 0.0;
+    int meshes_built = 0;
+
+    // Edit-to-upload time of block edits
+    LatencyHistogram edit_latency;
+    std::vector<BlockEdit> deferred_edits;
+    std::vector<BlockEdit> pending_edits;
+
+    // Chunks are loaded within render_distance and unloaded only past
+    // render_distance + unload_margin, so walking along the border does
+    // not churn them. Unloaded chunks wait in the cache, GL buffers
+    // included if cache_meshes is set.
+    int unload_margin = 2;
+    bool cache_meshes = false;
+    ChunkCache<Chunk> cache{64u << 20};
+
+    // Chunks drawn, frustum-culled and occlusion-culled in the last render
+    int chunks_drawn = 0;
+    int chunks_culled = 0;
+    int chunks_occluded = 0;
+    // Quads drawn, and quads of drawn sections skipped as back-facing
+    int quads_drawn = 0;
+    int quads_backfacing = 0;
+    bool occlusion_culling = true;
+    double occlusion_time_ms = 0.0;
+    static constexpr size_t OCCLUDER_CHUNKS = 32;
+    OcclusionCuller occlusion;
+    std::vector<Chunk *> visible_chunks;
+
+    // Sections reachable from the camera through open section faces, as a
+    // bit per section for each chunk column of the square around the
+    // camera chunk. Bit SECTION_COUNT is the open sky above the chunks.
+    bool cave_culling = true;
+    int chunks_unreachable = 0;
+    double visibility_time_ms = 0.0;
+    struct SectionStep {
+        int x, y, z;
+        int entered;        // Face the step came in through, -1 at the camera
+        uint8_t directions; // Face directions taken so far
+    };
+    std::vector<uint8_t> reachable;
+    int reachable_radius = 0;
+    std::vector<SectionStep> section_queue;
+
+    // Request-to-first-upload time of newly generated chunks, and of
+    // cache hits that still had to be remeshed
+    LatencyHistogram load_latency;
+    LatencyHistogram cache_hit_latency;
+
+    glm::vec3 cameraPosition{0.0f};
+    int cameraChunkX = 0;
+    int cameraChunkZ = 0;
+
+    static constexpr float VIEW_BIAS = 0.5f;
+    std::vector<glm::ivec2> load_offsets;
+    int load_offsets_radius = -1;
+    // Generation jobs queued or running
+    int generating = 0;
 
-    int cameraChunkX;
-    int cameraChunkZ;
+    // Generates and meshes chunks. Declared last so it is destroyed, and
+    // its threads joined, before the chunks they work on.
+    WorkerPool workers;
 
-    ChunkManager(Shader *shader) {
+    ChunkManager(Shader *shader, const BlockRegistry *registry)
+        : textures(registry, "blocks.vtx") {
         this->shader = shader;
-        chunks.reserve(render_distance * render_distance);
+        this->registry = registry;
+        chunks.reserve((2 * render_distance + 1) * (2 * render_distance + 1));
     };
     ~ChunkManager() = default;
 
-    void update(const glm::vec3 &cameraPosition) {
-        unload_chunks();
+    void update(const glm::vec3 &cameraPosition,
+                const glm::vec3 &cameraFront) {
+        this->workers.poll();
+        apply_deferred_edits();
         this->render_distance = glm::clamp(render_distance, 5, 20);
+        this->cameraPosition = cameraPosition;
         this->cameraChunkX =
             (int)(std::floor(cameraPosition.x / Chunk::CHUNK_SIZE));
         this->cameraChunkZ =
             (int)(std::floor(cameraPosition.z / Chunk::CHUNK_SIZE));
+        unload_chunks();
+        schedule_loads(cameraFront);
+        rebuild_dirty();
+        upload_meshed();
+        this->textures.trim();
+    }
+    bool in_range(int x, int z) const {
+        int dx = x - this->cameraChunkX;
+        int dz = z - this->cameraChunkZ;
+        return dx * dx + dz * dz <= render_distance * render_distance;
+    }
+    // Starts generating the missing chunks with the best score, keeping only
+    // a few jobs queued so the order follows the camera as it moves. The
+    // score is the distance, shrunk up to VIEW_BIAS for chunks ahead of the
+    // camera and grown as much for chunks behind it.
+    void schedule_loads(const glm::vec3 &cameraFront) {
+        if (this->load_offsets_radius != this->render_distance)
+            build_load_offsets();
+
+        int slots = 2 * this->workers.thread_count() - this->generating;
+        if (slots <= 0)
+            return;
 
-        for (int x = this->cameraChunkX - render_distance;
-             x <= this->cameraChunkX + render_distance; x++) {
-            for (int z = cameraChunkZ - render_distance;
-                 z <= cameraChunkZ + render_distance; z++) {
+        // Horizontal view direction, zero when looking straight up or down
+        float forwardX = cameraFront.x, forwardZ = cameraFront.z;
+        float length = std::sqrt(forwardX * forwardX + forwardZ * forwardZ);
+        if (length > 1e-3f) {
+            forwardX /= length;
+            forwardZ /= length;
+        } else {
+            forwardX = forwardZ = 0.0f;
+        }
 
-                std::string key = get_chunk_key(x, z);
-                if (chunks.find(key) == chunks.end())
-                    load_chunk(x, z);
+        std::vector<std::pair<float, glm::ivec2>> candidates;
+        for (const glm::ivec2 &offset : this->load_offsets) {
+            int x = this->cameraChunkX + offset.x;
+            int z = this->cameraChunkZ + offset.y;
+            if (this->chunks.contains(x, z))
+                continue;
+            float distance =
+                std::sqrt((float)(offset.x * offset.x + offset.y * offset.y));
+            float facing = 1.0f;
+            if (distance > 0.0f)
+                facing = (offset.x * forwardX + offset.y * forwardZ) / distance;
+            candidates.push_back({distance * (1.0f - VIEW_BIAS * facing),
+                                  glm::ivec2(x, z)});
+        }
+
+        size_t count = std::min(candidates.size(), (size_t)slots);
+        std::partial_sort(candidates.begin(), candidates.begin() + count,
+                          candidates.end(),
+                          [](const auto &a, const auto &b) {
+                              return a.first < b.first;
+                          });
+        for (size_t i = 0; i < count; i++)
+            load_chunk(candidates[i].second.x, candidates[i].second.y);
+    }
+    // Offsets inside the circular render distance, nearest first
+    void build_load_offsets() {
+        int radius = this->render_distance;
+        this->load_offsets.clear();
+        for (int x = -radius; x <= radius; x++) {
+            for (int z = -radius; z <= radius; z++) {
+                if (x * x + z * z <= radius * radius)
+                    this->load_offsets.push_back(glm::ivec2(x, z));
             }
         }
+        std::sort(this->load_offsets.begin(), this->load_offsets.end(),
+                  [](const glm::ivec2 &a, const glm::ivec2 &b) {
+                      return a.x * a.x + a.y * a.y < b.x * b.x + b.y * b.y;
+                  });
+        this->load_offsets_radius = radius;
     }
-    void render() {
-        this->shader->use();
+    // Draws the chunks whose occupied bounds intersect the frustum and,
+    // with cave_culling, the sections of them reachable from the camera;
+    // with occlusion_culling, chunks hidden behind the solid ground of the
+    // OCCLUDER_CHUNKS nearest visible chunks are skipped too
+    void render(const glm::mat4 &clip) {
+        Frustum frustum(clip);
+        this->chunks_drawn = this->chunks_culled = this->chunks_occluded = 0;
+        this->chunks_unreachable = 0;
+        if (this->cave_culling)
+            find_reachable_sections(frustum);
+        else
+            this->visibility_time_ms = 0.0;
+
+        this->visible_chunks.clear();
         for (const auto &[key, chunk] : this->chunks) {
-            glm::mat4 model = glm::translate(
-                glm::mat4(1.0f),
-                glm::vec3(chunk->chunk_position.x * Chunk::CHUNK_SIZE, 0,
-                          chunk->chunk_position.y * Chunk::CHUNK_SIZE));
+            if (!chunk->buffer || chunk->draw_min_y > chunk->draw_max_y)
+                continue;
+            glm::vec3 min, max;
+            chunk_bounds(*chunk, min, max);
+            if (!frustum.intersects(min, max)) {
+                this->chunks_culled++;
+                continue;
+            }
+            if (!reachable_sections(*chunk)) {
+                this->chunks_unreachable++;
+                continue;
+            }
+            this->visible_chunks.push_back(chunk.get());
+        }
+        if (this->occlusion_culling)
+            cull_occluded(clip);
+        else
+            this->occlusion_time_ms = 0.0;
+
+        this->shader->use();
+        this->textures.bind();
+        this->quads_drawn = this->quads_backfacing = 0;
+        for (Chunk *chunk : this->visible_chunks) {
+            this->chunks_drawn++;
+
+            glm::vec3 origin(chunk->chunk_position.x * Chunk::CHUNK_SIZE, 0,
+                             chunk->chunk_position.y * Chunk::CHUNK_SIZE);
+            uint8_t sections = reachable_sections(*chunk);
+            int quads = chunk->render(this->cameraPosition - origin, sections);
+            this->quads_drawn += quads;
+            this->quads_backfacing += chunk->uploaded_quads(sections) - quads;
+        };
+        this->chunk_buffer.flush();
+    }
+    uint8_t reachable_sections(const Chunk &chunk) const {
+        if (!this->cave_culling)
+            return Chunk::ALL_SECTIONS;
+        int radius = this->reachable_radius;
+        int dx = (int)chunk.chunk_position.x - this->cameraChunkX;
+        int dz = (int)chunk.chunk_position.y - this->cameraChunkZ;
+        if (std::abs(dx) > radius || std::abs(dz) > radius)
+            return 0;
+        return this->reachable[(dx + radius) * (2 * radius + 1) + dz + radius] &
+               Chunk::ALL_SECTIONS;
+    }
+    // Breadth-first search over sections from the camera's (the cave
+    // culling of Minecraft renderers). A step leaves a section only through
+    // a face connected to the one it came in by, never reverses a
+    // direction already taken, and never leaves the frustum. Unmeshed
+    // sections and the sky are open.
+    void find_reachable_sections(const Frustum &frustum) {
+        double start = glfwGetTime();
+        const int sky = Chunk::SECTION_COUNT;
+        int radius = this->render_distance + this->unload_margin;
+        int side = 2 * radius + 1;
+        this->reachable_radius = radius;
+
+        // Below the world nothing connects; draw whatever is in view
+        if (this->cameraPosition.y < 0) {
+            this->reachable.assign(side * side, Chunk::ALL_SECTIONS);
+            this->visibility_time_ms = (glfwGetTime() - start) * 1000.0;
+            return;
+        }
+        this->reachable.assign(side * side, 0);
+        int camera_y = std::min(
+            sky, (int)this->cameraPosition.y / Chunk::SECTION_HEIGHT);
+        this->section_queue.clear();
+        this->section_queue.push_back(
+            {this->cameraChunkX, camera_y, this->cameraChunkZ, -1, 0});
+        this->reachable[radius * side + radius] |= 1 << camera_y;
 
-            this->shader->set_mat4("model", model);
-            chunk->render();
+        for (size_t head = 0; head < this->section_queue.size(); head++) {
+            SectionStep step = this->section_queue[head];
+            uint16_t connectivity = Chunk::ALL_FACE_PAIRS;
+            if (step.y < sky) {
+                const Chunk *chunk = this->chunks.find(step.x, step.z);
+                if (chunk && chunk->buffer)
+                    connectivity = chunk->draw_connectivity[step.y];
+            }
+            for (int face = 0; face < 6; face++) {
+                if (step.directions & (1 << (face ^ 1)))
+                    continue;
+                if (step.entered >= 0 &&
+                    !(connectivity >> Chunk::face_pair_bit(step.entered, face) &
+                      1))
+                    continue;
+                const int *offset = Chunk::face_offsets[face];
+                int x = step.x + offset[0], y = step.y + offset[1],
+                    z = step.z + offset[2];
+                int dx = x - this->cameraChunkX, dz = z - this->cameraChunkZ;
+                if (y < 0 || y > sky || std::abs(dx) > radius ||
+                    std::abs(dz) > radius)
+                    continue;
+                uint8_t &column =
+                    this->reachable[(dx + radius) * side + dz + radius];
+                if (column & (1 << y))
+                    continue;
+
+                glm::vec3 min(x * Chunk::CHUNK_SIZE,
+                              y * Chunk::SECTION_HEIGHT,
+                              z * Chunk::CHUNK_SIZE);
+                glm::vec3 max(min.x + Chunk::CHUNK_SIZE,
+                              min.y + Chunk::SECTION_HEIGHT,
+                              min.z + Chunk::CHUNK_SIZE);
+                if (y == sky)
+                    max.y = std::max(max.y, this->cameraPosition.y + 1);
+                if (!frustum.intersects(min, max))
+                    continue;
+
+                column |= 1 << y;
+                this->section_queue.push_back(
+                    {x, y, z, face ^ 1,
+                     (uint8_t)(step.directions | 1 << face)});
+            }
+        }
+        this->visibility_time_ms = (glfwGetTime() - start) * 1000.0;
+    }
+    void chunk_bounds(const Chunk &chunk, glm::vec3 &min,
+                      glm::vec3 &max) const {
+        min = glm::vec3(chunk.chunk_position.x * Chunk::CHUNK_SIZE,
+                        chunk.draw_min_y,
+                        chunk.chunk_position.y * Chunk::CHUNK_SIZE);
+        max = glm::vec3(min.x + Chunk::CHUNK_SIZE, chunk.draw_max_y + 1,
+                        min.z + Chunk::CHUNK_SIZE);
+    }
+    // Removes the chunks hidden by the occluder boxes of the nearest ones
+    // from visible_chunks
+    void cull_occluded(const glm::mat4 &clip) {
+        double start = glfwGetTime();
+        auto distance = [this](const Chunk *chunk) {
+            int dx = chunk->chunk_position.x - this->cameraChunkX;
+            int dz = chunk->chunk_position.y - this->cameraChunkZ;
+            return dx * dx + dz * dz;
         };
+        auto nearest = this->visible_chunks.begin() +
+                       std::min(this->visible_chunks.size(), OCCLUDER_CHUNKS);
+        std::partial_sort(this->visible_chunks.begin(), nearest,
+                          this->visible_chunks.end(),
+                          [&](const Chunk *a, const Chunk *b) {
+                              return distance(a) < distance(b);
+                          });
+
+        const int cell = Chunk::OCCLUDER_CELL;
+        this->occlusion.begin(clip);
+        for (auto it = this->visible_chunks.begin(); it != nearest; it++) {
+            const Chunk &chunk = **it;
+            for (int cx = 0; cx < Chunk::OCCLUDER_CELLS; cx++) {
+                // One box per run of equally high cells along z
+                int cz = 0;
+                while (cz < Chunk::OCCLUDER_CELLS) {
+                    int height = chunk.draw_occluders[cx][cz];
+                    int end = cz + 1;
+                    while (end < Chunk::OCCLUDER_CELLS &&
+                           chunk.draw_occluders[cx][end] == height)
+                        end++;
+                    if (height) {
+                        float x = chunk.chunk_position.x * Chunk::CHUNK_SIZE +
+                                  cx * cell;
+                        float z = chunk.chunk_position.y * Chunk::CHUNK_SIZE;
+                        this->occlusion.add_occluder(
+                            glm::vec3(x, 0, z + cz * cell),
+                            glm::vec3(x + cell, height, z + end * cell));
+                    }
+                    cz = end;
+                }
+            }
+        }
+        this->occlusion.finish();
+
+        std::erase_if(this->visible_chunks, [this](const Chunk *chunk) {
+            glm::vec3 min, max;
+            chunk_bounds(*chunk, min, max);
+            if (this->occlusion.is_visible(min, max))
+                return false;
+            this->chunks_occluded++;
+            return true;
+        });
+        this->occlusion_time_ms = (glfwGetTime() - start) * 1000.0;
+    }
+    // Chunk whose voxels are safe to read on the main thread, or nullptr
+    Chunk *find_generated(int x, int z) const {
+        Chunk *chunk = this->chunks.find(x, z);
+        if (!chunk || chunk->state == Chunk::State::Queued)
+            return nullptr;
+        return chunk;
     }
     void load_chunk(int x, int z) {
-        std::string key = this->get_chunk_key(x, z);
-        this->chunks[key] = std::make_unique<Chunk>(x, z);
+        // Voxels, edits included, come back from the cache without
+        // regenerating; only the mesh is rebuilt against the current
+        // neighbors unless the cached GL buffers can be drawn meanwhile.
+        if (std::unique_ptr<Chunk> cached = this->cache.take(x, z)) {
+            Chunk *chunk = this->chunks.insert(x, z, std::move(cached));
+            chunk->load_requested = glfwGetTime();
+            chunk->cache_hit = true;
+            chunk->state = chunk->buffer ? Chunk::State::Uploaded
+                                      : Chunk::State::Generated;
+            mark_dirty(x, z);
+            mark_dirty(x - 1, z);
+            mark_dirty(x + 1, z);
+            mark_dirty(x, z - 1);
+            mark_dirty(x, z + 1);
+            return;
+        }
+
+        Chunk *chunk = this->chunks.insert(
+            x, z, std::make_unique<Chunk>(x, z, this->registry));
+        chunk->in_flight = true;
+        chunk->load_requested = glfwGetTime();
+        this->generating++;
+        this->workers.submit([this, chunk, x, z]() -> WorkerPool::Completion {
+            chunk->generate_terrain();
+            return [this, chunk, x, z] {
+                this->generating--;
+                chunk->in_flight = false;
+                chunk->state = Chunk::State::Generated;
+                // The new chunk can hide the border faces of the ones
+                // around it
+                mark_dirty(x, z);
+                mark_dirty(x - 1, z);
+                mark_dirty(x + 1, z);
+                mark_dirty(x, z - 1);
+                mark_dirty(x, z + 1);
+            };
+        });
     }
-    void unload_chunks() {
-        for (auto it = chunks.begin(); it != chunks.end();) {
-            size_t delim_pos = it->first.find(':');
-            int chunkX = std::stoi(it->first.substr(0, delim_pos));
-            int chunkZ = std::stoi(it->first.substr(delim_pos + 1));
-
-            bool render_distance_condition =
-                std::abs(chunkX - cameraChunkX) > render_distance or
-                std::abs(chunkZ - cameraChunkZ) > render_distance;
-
-            if (render_distance_condition) {
-                it = this->chunks.erase(it);
-            } else {
-                it++;
+    void modify_block(Chunk *chunk, int x, int y, int z,
+                      Block::BlockType type) {
+        BlockEdit edit = {
+            glm::ivec2(chunk->chunk_position.x, chunk->chunk_position.y),
+            glm::ivec3(x, y, z), type, glfwGetTime()};
+        // Queue behind earlier deferred edits to keep them in order
+        if (!this->deferred_edits.empty() || !can_edit(chunk)) {
+            this->deferred_edits.push_back(edit);
+            return;
+        }
+        apply_edit(chunk, edit);
+    }
+    // Workers neither write this chunk nor read it as a neighbor
+    static bool can_edit(const Chunk *chunk) {
+        return chunk->state != Chunk::State::Queued && !chunk->in_flight &&
+               chunk->readers == 0;
+    }
+    void apply_deferred_edits() {
+        std::vector<BlockEdit> waiting;
+        for (const BlockEdit &edit : this->deferred_edits) {
+            Chunk *chunk = this->chunks.find(edit.chunk.x, edit.chunk.y);
+            if (!chunk)
+                continue;
+            if (can_edit(chunk))
+                apply_edit(chunk, edit);
+            else
+                waiting.push_back(edit);
+        }
+        this->deferred_edits.swap(waiting);
+    }
+    void apply_edit(Chunk *chunk, const BlockEdit &edit) {
+        int x = edit.block.x, y = edit.block.y, z = edit.block.z;
+        if (!chunk->modify_block(x, y, z, edit.type))
+            return;
+
+        this->pending_edits.push_back(edit);
+
+        // The edited section, plus the one above or below when the block
+        // sits on a section boundary and hides or exposes its faces
+        int section = y / Chunk::SECTION_HEIGHT;
+        uint8_t sections = 1 << section;
+        if (y % Chunk::SECTION_HEIGHT == 0 && section > 0)
+            sections |= 1 << (section - 1);
+        if (y % Chunk::SECTION_HEIGHT == Chunk::SECTION_HEIGHT - 1 &&
+            section < Chunk::SECTION_COUNT - 1)
+            sections |= 1 << (section + 1);
+
+        int chunkX = edit.chunk.x;
+        int chunkZ = edit.chunk.y;
+        mark_dirty(chunkX, chunkZ, sections);
+        // Border blocks only touch the same section of the neighbor
+        if (x == 0)
+            mark_dirty(chunkX - 1, chunkZ, 1 << section);
+        if (x == Chunk::CHUNK_SIZE - 1)
+            mark_dirty(chunkX + 1, chunkZ, 1 << section);
+        if (z == 0)
+            mark_dirty(chunkX, chunkZ - 1, 1 << section);
+        if (z == Chunk::CHUNK_SIZE - 1)
+            mark_dirty(chunkX, chunkZ + 1, 1 << section);
+    }
+    void mark_dirty(int x, int z, uint8_t sections = Chunk::ALL_SECTIONS) {
+        Chunk *chunk = this->chunks.find(x, z);
+        if (!chunk)
+            return;
+        if (!chunk->dirty_sections)
+            this->dirty_chunks.push_back(glm::ivec2(x, z));
+        chunk->dirty_sections |= sections;
+    }
+    // Re-meshes every loaded chunk with the new mesher on the next update
+    void set_mesh_mode(Chunk::MeshMode mode) {
+        this->mesh_mode = mode;
+        this->mesh_time_ms = 0.0;
+        this->meshes_built = 0;
+        for (const auto &[key, chunk] : this->chunks) {
+            mark_dirty(ChunkTable<Chunk>::unpack_x(key),
+                       ChunkTable<Chunk>::unpack_z(key));
+        }
+    }
+    // Dispatches mesh jobs for dirty chunks whose voxels and neighbors are
+    // ready; the rest stay dirty for a later frame.
+    void rebuild_dirty() {
+        std::vector<glm::ivec2> waiting;
+        for (const glm::ivec2 &pos : this->dirty_chunks) {
+            Chunk *chunk = this->chunks.find(pos.x, pos.y);
+            if (!chunk || !chunk->dirty_sections)
+                continue;
+
+            Chunk *neighbors[4] = {
+                this->chunks.find(pos.x - 1, pos.y),
+                this->chunks.find(pos.x + 1, pos.y),
+                this->chunks.find(pos.x, pos.y - 1),
+                this->chunks.find(pos.x, pos.y + 1),
+            };
+            bool ready = chunk->state == Chunk::State::Generated ||
+                         chunk->state == Chunk::State::Uploaded;
+            ready = ready && !chunk->in_flight;
+            for (const Chunk *neighbor : neighbors) {
+                if (neighbor && neighbor->state == Chunk::State::Queued)
+                    ready = false;
+            }
+            if (!ready) {
+                waiting.push_back(pos);
+                continue;
+            }
+
+            uint8_t sections = chunk->dirty_sections;
+            chunk->dirty_sections = 0;
+            chunk->in_flight = true;
+            chunk->pin_textures(this->textures);
+            for (Chunk *neighbor : neighbors) {
+                if (neighbor)
+                    neighbor->readers++;
+            }
+
+            Chunk::MeshMode mode = this->mesh_mode;
+            double dispatched = glfwGetTime();
+            this->workers.submit([=, this]() -> WorkerPool::Completion {
+                double start = glfwGetTime();
+                chunk->build_mesh(neighbors, mode, sections);
+                double ms = (glfwGetTime() - start) * 1000.0;
+                return [=, this] {
+                    chunk->in_flight = false;
+                    for (Chunk *neighbor : neighbors) {
+                        if (neighbor)
+                            neighbor->readers--;
+                    }
+                    chunk->state = Chunk::State::Meshed;
+                    this->upload_queue.push_back({pos, dispatched});
+                    this->mesh_time_ms += ms;
+                    this->meshes_built++;
+                };
+            });
+        }
+        this->dirty_chunks.swap(waiting);
+    }
+    // Uploads meshed chunks until the frame's upload budget is spent
+    void upload_meshed() {
+        double start = glfwGetTime();
+        bool uploaded = false;
+        while (!this->upload_queue.empty()) {
+            double elapsed_ms = (glfwGetTime() - start) * 1000.0;
+            if (uploaded && elapsed_ms > this->upload_budget_ms)
+                break;
+
+            MeshedChunk meshed = this->upload_queue.front();
+            this->upload_queue.pop_front();
+            Chunk *chunk = this->chunks.find(meshed.chunk.x, meshed.chunk.y);
+            if (!chunk || chunk->state != Chunk::State::Meshed)
+                continue;
+
+            if (!chunk->buffer) {
+                LatencyHistogram &latency = chunk->cache_hit
+                                                ? this->cache_hit_latency
+                                                : this->load_latency;
+                latency.record(glfwGetTime() - chunk->load_requested);
             }
+            chunk->upload_to_gpu(this->chunk_buffer);
+            if (!this->keep_mesh_data)
+                chunk->release_mesh_data();
+            chunk->state = Chunk::State::Uploaded;
+            uploaded = true;
+            record_edit_latency(meshed);
+        }
+    }
+    // Edits made before the mesh job was dispatched are now visible
+    void record_edit_latency(const MeshedChunk &meshed) {
+        if (this->pending_edits.empty())
+            return;
+        double now = glfwGetTime();
+        std::erase_if(this->pending_edits, [&](const BlockEdit &edit) {
+            if (edit.chunk != meshed.chunk || edit.start > meshed.dispatched)
+                return false;
+            this->edit_latency.record(now - edit.start);
+            return true;
+        });
+    }
+    // Moves chunks past the unload radius into the cache. Chunks workers
+    // are using go on a later frame.
+    void unload_chunks() {
+        int radius = this->render_distance + this->unload_margin;
+        std::vector<glm::ivec2> evicted;
+        for (const auto &[key, chunk] : this->chunks) {
+            if (chunk->in_flight || chunk->readers > 0)
+                continue;
+            int dx = ChunkTable<Chunk>::unpack_x(key) - this->cameraChunkX;
+            int dz = ChunkTable<Chunk>::unpack_z(key) - this->cameraChunkZ;
+            if (dx * dx + dz * dz > radius * radius)
+                evicted.push_back(glm::ivec2(ChunkTable<Chunk>::unpack_x(key),
+                                             ChunkTable<Chunk>::unpack_z(key)));
+        }
+        for (const glm::ivec2 &pos : evicted) {
+            std::unique_ptr<Chunk> chunk = this->chunks.take(pos.x, pos.y);
+            // Never generated, nothing worth keeping
+            if (chunk->state == Chunk::State::Queued)
+                continue;
+            chunk->dirty_sections = 0;
+            chunk->release_mesh_data();
+            if (!this->cache_meshes)
+                chunk->release_gpu();
+            size_t bytes = chunk->cache_memory_usage();
+            this->cache.put(pos.x, pos.y, std::move(chunk), bytes);
         }
     }
-    std::string get_chunk_key(int x, int z) const {
-        return std::to_string(x) + ":" + std::to_string(z);
+    size_t voxel_memory_usage() const {
+        size_t bytes = 0;
+        for (const auto &[key, chunk] : this->chunks) {
+            if (!chunk->in_flight)
+                bytes += chunk->memory_usage();
+        }
+        return bytes;
+    }
+    size_t mesh_memory_usage() const {
+        size_t bytes = 0;
+        for (const auto &[key, chunk] : this->chunks) {
+            if (!chunk->in_flight)
+                bytes += chunk->mesh_memory_usage();
+        }
+        return bytes;
+    }
+    // Total faces meshed and border faces hidden by neighbor chunks
+    void face_stats(int &faces, int &border_culled) const {
+        faces = border_culled = 0;
+        for (const auto &[key, chunk] : this->chunks) {
+            if (chunk->in_flight)
+                continue;
+            faces += chunk->face_count;
+            border_culled += chunk->border_faces_culled;
+        }
+    }
+    // Number of loaded sections per Chunk::SectionState
+    void section_stats(int counts[3]) const {
+        counts[0] = counts[1] = counts[2] = 0;
+        for (const auto &[key, chunk] : this->chunks) {
+            if (chunk->in_flight)
+                continue;
+            for (int i = 0; i < Chunk::SECTION_COUNT; i++)
+                counts[(int)chunk->section_state(i)]++;
+        }
     }
 };
@@ -6,9 +6,9 @@
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
+#include "memory_stats.h"
 #include "model.h"
 #include "shader.hpp"
-#include "textures.h"
 #include <cassert>
 
 void Engine::handle_mouse_callback(double xpos, double ypos) {
@@ -199,70 +199,57 @@ void Engine::setup_shaders() {
         std::make_unique<Shader>("hud_vertex.glsl", "hud_fragment.glsl");
     this->obj_shader =
         std::make_unique<Shader>("obj_vertex.glsl", "obj_fragment.glsl");
+    this->frame_uniforms = std::make_unique<FrameUniforms>();
+    this->obj_model_uniform = this->obj_shader->uniform("model");
 }
 void Engine::setup_objects() {
     this->porsche = new Model("930.glb");
     this->doom = new Model("doom.glb");
-    this->load_textures("grass_block_top.png", Block::BlockTexture::GRASS_TOP);
-    this->load_textures("dirt.png", Block::BlockTexture::GRASS_BOTTOM);
-    this->load_textures("spruce_log.png", Block::BlockTexture::WOOD);
-    this->load_textures("oak_leaves.png", Block::BlockTexture::LEAF);
-    this->load_textures("sand.png", Block::BlockTexture::SAND);
-    this->load_textures("spruce_log_top.png", Block::BlockTexture::WOOD_TOP);
-    this->load_textures("grass_block_side.png",
-                        Block::BlockTexture::GRASS_SIDE);
-    this->shader->use();
-
-    for (const auto &[textureType, textureID] : this->textures) {
-        int textureUnit = (int)(textureType);
-        glActiveTexture(GL_TEXTURE0 + textureUnit);
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        std::string uniformName =
-            "textures[" + std::to_string(textureUnit) + "]";
+    this->registry = std::make_unique<BlockRegistry>();
+    this->registry->load("blocks.txt");
 
-        this->shader->set_int(uniformName, textureUnit);
+    this->shader->use();
+    // Block textures are layers of one array on unit 0, loaded as chunks
+    // use them (see TextureResidency)
+    this->shader->set_int("textures", 0);
+    for (size_t i = 0; i < this->registry->tints.size(); i++) {
+        this->shader->set_vec3("tints[" + std::to_string(i) + "]",
+                               this->registry->tints[i]);
     }
+    this->obj_shader->use();
+    this->obj_shader->set_int("diffuseMap", 15);
     Shader::stop();
 
-    this->chunker = std::make_unique<ChunkManager>(shader.get());
+    this->chunker =
+        std::make_unique<ChunkManager>(shader.get(), this->registry.get());
     this->camera = std::make_unique<Camera>(glm::vec3(0.0f, 15.0f, 0.0f));
     this->hud = std::make_unique<Hud>();
 }
-void Engine::load_textures(const std::string &path,
-                           Block::BlockTexture textureID) {
-    uint texture = load_textures_from_file(path);
-    this->textures[textureID] = texture;
-}
 void Engine::render() {
     glClearColor(119.0f / 255.0f, 168.0f / 255.0f, 1.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    this->frame_uniforms->update(this->view, this->projection,
+                                 (float)glfwGetTime());
+
     this->model = glm::identity<glm::mat4>();
     this->shader->use();
-    this->shader->set_mat4("view", this->view);
-    this->shader->set_mat4("model", this->model);
-    this->shader->set_mat4("projection", this->projection);
-    this->shader->set_float("time", (float)glfwGetTime());
     glFrontFace(GL_CW);
-    this->chunker->render();
+    this->chunker->render(this->projection * this->view);
 
     this->hud_shader->use();
     this->hud->render();
 
     this->model = glm::translate(model, glm::vec3{0.0, 20.0, -5.0});
     this->obj_shader->use();
-    this->obj_shader->set_mat4("model", this->model);
-    this->obj_shader->set_mat4("view", this->view);
-    this->obj_shader->set_mat4("projection", this->projection);
-    this->obj_shader->set_float("time", (float)glfwGetTime());
-    this->obj_shader->set_int("diffuseMap", 10);
+    this->obj_shader->set_mat4(this->obj_model_uniform, this->model);
     glFrontFace(GL_CCW);
     this->porsche->render();
 
     this->model = glm::mat4(1.0f);
     this->model = glm::translate(model, glm::vec3{0.0, 20.0, 15.0});
     this->model = glm::scale(model, glm::vec3{0.03, 0.03, 0.03});
-    this->obj_shader->set_mat4("model", this->model);
+    this->obj_shader->set_mat4(this->obj_model_uniform, this->model);
     this->doom->render();
 
     this->render_imgui();
@@ -292,6 +279,102 @@ void Engine::render_imgui() {
     ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x * 0.5f);
     ImGui::InputInt("Render Distance", &this->chunker->render_distance, 1, 20);
     ImGui::Text("Loaded chunks: %lu", this->chunker->chunks.size());
+    ImGui::Text("Chunks drawn/frustum-culled: %d/%d",
+                this->chunker->chunks_drawn, this->chunker->chunks_culled);
+    ImGui::Text("Quads drawn: %d, back-facing skipped: %d",
+                this->chunker->quads_drawn, this->chunker->quads_backfacing);
+    const ChunkBuffer &buffer = this->chunker->chunk_buffer;
+    ImGui::Text("Draw calls: %d, VAO binds: %d (%s)", buffer.draw_calls,
+                buffer.vao_binds,
+                buffer.indirect ? "multi-draw indirect" : "multi-draw");
+    ImGui::Text("Chunk buffer: %lu/%lu KB used, %d free ranges",
+                buffer.used_bytes() >> 10, buffer.memory_usage() >> 10,
+                buffer.free_range_count());
+    const TextureResidency &textures = this->chunker->textures;
+    ImGui::Text("Block textures: %d/%d layers (%d pinned), %lu KB, %s",
+                textures.resident(), textures.capacity(), textures.pinned(),
+                textures.memory_usage() >> 10, textures.source().c_str());
+    ImGui::Text("Texture loads: %d (%.2f ms), evictions: %d", textures.loads,
+                textures.load_time_ms, textures.evictions);
+    ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x * 0.5f);
+    ImGui::InputInt("Texture budget", &this->chunker->textures.budget, 16,
+                    64);
+    ImGui::Checkbox("Cave culling", &this->chunker->cave_culling);
+    ImGui::SameLine();
+    ImGui::Text("%d unreachable, %.3f ms", this->chunker->chunks_unreachable,
+                this->chunker->visibility_time_ms);
+    ImGui::Checkbox("Occlusion", &this->chunker->occlusion_culling);
+    ImGui::SameLine();
+    ImGui::Text("%d occluded, %.3f ms", this->chunker->chunks_occluded,
+                this->chunker->occlusion_time_ms);
+    const ChunkCache<Chunk> &cache = this->chunker->cache;
+    ImGui::Text("Chunk cache: %lu chunks, %lu KB, hit rate %.0f%% (%d/%d)",
+                cache.size(), cache.memory_usage() >> 10,
+                cache.hit_rate() * 100.0f, cache.hits,
+                cache.hits + cache.misses);
+    ImGui::SameLine();
+    ImGui::Checkbox("Meshes", &this->chunker->cache_meshes);
+    ImGui::Text("Workers: %d threads, %d jobs, %lu uploads queued",
+                this->chunker->workers.thread_count(),
+                this->chunker->workers.pending(),
+                this->chunker->upload_queue.size());
+    ImGui::Text("Resident memory: %lu MB", resident_set_bytes() >> 20);
+    ImGui::Text("CPU mesh memory: %lu KB",
+                this->chunker->mesh_memory_usage() >> 10);
+    ImGui::SameLine();
+    ImGui::Checkbox("Keep", &this->chunker->keep_mesh_data);
+    if (!this->chunker->chunks.empty()) {
+        size_t bytes_per_chunk = this->chunker->voxel_memory_usage() /
+                                 this->chunker->chunks.size();
+        ImGui::Text("Voxel bytes/chunk: %lu (unpacked %lu)", bytes_per_chunk,
+                    Chunk::UNPACKED_BYTES);
+        int sections[3];
+        this->chunker->section_stats(sections);
+        ImGui::Text("Sections empty/uniform/mixed: %d/%d/%d", sections[0],
+                    sections[1], sections[2]);
+        int faces, border_culled;
+        this->chunker->face_stats(faces, border_culled);
+        ImGui::Text("Faces: %d (border faces culled: %d)", faces,
+                    border_culled);
+        // Every mesh vertex is uploaded once per rebuild, so this is also
+        // the upload size of a full remesh.
+        ImGui::Text("Vertices: %d (%lu KB, unpacked %lu KB)", faces * 4,
+                    faces * 4 * sizeof(Chunk::Vertex) / 1024,
+                    faces * 4 * Chunk::UNPACKED_VERTEX_BYTES / 1024);
+    }
+    int mesh_mode = (int)this->chunker->mesh_mode;
+    ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x * 0.5f);
+    if (ImGui::Combo("Mesher", &mesh_mode, "Naive\0Greedy\0"))
+        this->chunker->set_mesh_mode((Chunk::MeshMode)mesh_mode);
+    if (this->chunker->meshes_built > 0) {
+        ImGui::Text("Mesh build: %.3f ms/chunk (%d meshes)",
+                    this->chunker->mesh_time_ms / this->chunker->meshes_built,
+                    this->chunker->meshes_built);
+    }
+    const LatencyHistogram &loads = this->chunker->load_latency;
+    if (loads.total > 0) {
+        ImGui::Text("Chunk load-to-visible: p50 < %.0f ms, p99 < %.0f ms",
+                    loads.percentile(0.5) / 1000.0,
+                    loads.percentile(0.99) / 1000.0);
+    }
+    const LatencyHistogram &hits = this->chunker->cache_hit_latency;
+    if (hits.total > 0) {
+        ImGui::Text("Cache hit-to-visible: p50 < %.0f ms, p99 < %.0f ms",
+                    hits.percentile(0.5) / 1000.0,
+                    hits.percentile(0.99) / 1000.0);
+    }
+    const LatencyHistogram &latency = this->chunker->edit_latency;
+    if (latency.total > 0) {
+        float buckets[LatencyHistogram::BUCKETS];
+        latency.values(buckets);
+        ImGui::Text("Edit latency: p50 < %.0f us, p99 < %.0f us, max %.0f us",
+                    latency.percentile(0.5), latency.percentile(0.99),
+                    latency.max_us);
+        ImGui::PlotHistogram("##edit_latency", buckets,
+                             LatencyHistogram::BUCKETS, 0,
+                             "log2 us buckets", 0.0f, FLT_MAX,
+                             ImVec2(0, 60));
+    }
     ImGui::Text("Camera Position:");
     ImGui::SameLine();
     ImGui::TextColored(ImVec4(1, 1, 0, 1), "X:%.2f Y:%.2f Z:%.2f",
@@ -357,24 +440,22 @@ void Engine::input() {
                 continue;
             }
 
-            auto chunkKey = this->chunker->get_chunk_key(chunkX, chunkZ);
-            if (this->chunker->chunks.count(chunkKey)) {
-                auto &chunk = this->chunker->chunks[chunkKey];
-                auto &block = chunk->blocks[blockX][blockY][blockZ];
+            Chunk *chunk = this->chunker->find_generated(chunkX, chunkZ);
+            if (chunk) {
+                bool solid = chunk->is_solid(blockX, blockY, blockZ);
 
                 // Remove
-                if (!prevLeftMousePressed and leftMousePressed and
-                    block.type != Block::BlockType::Air) {
-                    chunk->modify_block(blockX, blockY, blockZ,
-                                        Block::BlockType::Air);
+                if (!prevLeftMousePressed and leftMousePressed and solid) {
+                    this->chunker->modify_block(chunk, blockX, blockY, blockZ,
+                                                Block::BlockType::Air);
                     break;
                 }
 
                 // Add
                 if (!prevRightMousePressed and rightMousePressed and step > 2) {
                     // +1 to place on block above
-                    chunk->modify_block(blockX, blockY, blockZ,
-                                        Block::BlockType::Dirt);
+                    this->chunker->modify_block(chunk, blockX, blockY, blockZ,
+                                                Block::BlockType::Dirt);
                     break;
                 }
             }
@@ -400,7 +481,7 @@ void Engine::update() {
     }
     frameCount++;
 
-    this->chunker->update(camera->Position);
+    this->chunker->update(camera->Position, camera->Front);
 
     if (this->wireframe)
         glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
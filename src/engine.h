@@ -2,6 +2,7 @@
 #pragma once
 #include "camera.h"
 #include "chunker.h"
+#include "frame_uniforms.h"
 #include "glad.h"
 #include "hud.h"
 #include "model.h"
@@ -11,7 +12,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <memory>
-#include <unordered_map>
+#include <vector>
 
 struct Engine {
   private:
@@ -29,8 +30,10 @@ struct Engine {
     std::unique_ptr<Shader> shader;
     std::unique_ptr<Shader> hud_shader;
     std::unique_ptr<Shader> obj_shader;
+    std::unique_ptr<FrameUniforms> frame_uniforms;
+    GLint obj_model_uniform = -1;
     std::unique_ptr<Hud> hud;
-    std::unordered_map<Block::BlockTexture, unsigned int> textures;
+    std::unique_ptr<BlockRegistry> registry;
 
     Model *porsche;
     Model *doom;
@@ -46,8 +49,6 @@ struct Engine {
     void setup_imgui();
     void setup_objects();
     void setup_shaders();
-    void load_textures(const std::string &path,
-                       Block::BlockTexture textureType);
     void load_scene(const std::string &filename);
 
     std::unique_ptr<Camera> camera;
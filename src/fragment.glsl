@@ -3,11 +3,17 @@ in vec2 TexCoord;
 in vec3 Normal;
 in vec3 FragPos;
 flat in int TextureIndex;
+flat in int TintIndex;
 
 out vec4 FragColor;
 
-uniform sampler2D textures[7];
-uniform float time;
+uniform sampler2DArray textures; // layer per block texture
+uniform vec3 tints[16]; // tints[0] is white
+layout(std140) uniform Frame { // see FrameUniforms
+    mat4 view;
+    mat4 projection;
+    float time;
+};
 
 uniform vec3 lightDir =
     normalize(vec3(-0.5, -1.0, -0.5));           // Directional light (sun)
@@ -15,12 +21,8 @@ uniform vec3 lightColor = vec3(1.0, 0.98, 0.95); // Slightly yellowish light
 uniform float ambientStrength = 0.3;             // Ambient light intensity
 
 void main() {
-    vec4 texColor = texture(textures[TextureIndex], TexCoord);
-    if (TextureIndex == 0) { // Grass Top
-        texColor.rgb *= vec3(0.61, 0.8, 0.42);
-    } else if (TextureIndex == 4) { // Leaf
-        texColor.rgb *= vec3(0.61, 0.8, 0.42);
-    }
+    vec4 texColor = texture(textures, vec3(TexCoord, TextureIndex));
+    texColor.rgb *= tints[TintIndex];
 
     // vec3 norm = normalize(Normal);
     vec3 norm = Normal;
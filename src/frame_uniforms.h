@@ -0,0 +1,40 @@
+// frame_uniforms.h
+#pragma once
+#include "glad.h"
+#include "shader.hpp"
+#include <glm/glm.hpp>
+
+// Camera matrices and time, shared by every program through the std140
+// uniform block
+//   layout(std140) uniform Frame { mat4 view; mat4 projection; float time; };
+// and uploaded once per frame instead of set on each program.
+struct FrameUniforms {
+    struct Block {
+        glm::mat4 view;
+        glm::mat4 projection;
+        float time;
+        float padding[3];
+    };
+    static_assert(sizeof(Block) == 144, "std140 layout of Frame");
+
+    uint ubo = 0;
+
+    FrameUniforms() {
+        glGenBuffers(1, &this->ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, this->ubo);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), nullptr,
+                     GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, Shader::FRAME_BLOCK_BINDING,
+                         this->ubo);
+    }
+    ~FrameUniforms() { glDeleteBuffers(1, &this->ubo); }
+    FrameUniforms(const FrameUniforms &) = delete;
+    FrameUniforms &operator=(const FrameUniforms &) = delete;
+
+    void update(const glm::mat4 &view, const glm::mat4 &projection,
+                float time) {
+        Block block{view, projection, time, {}};
+        glBindBuffer(GL_UNIFORM_BUFFER, this->ubo);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Block), &block);
+    }
+};
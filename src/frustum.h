@@ -0,0 +1,41 @@
+// frustum.h
+#pragma once
+#include <glm/glm.hpp>
+
+// View frustum as six inward-facing planes (a, b, c, d) with
+// a*x + b*y + c*z + d >= 0 inside, extracted from a clip matrix
+// (Gribb/Hartmann). Plane normals are not normalized; the AABB test only
+// needs the sign.
+struct Frustum {
+    glm::vec4 planes[6];
+
+    explicit Frustum(const glm::mat4 &clip) {
+        // glm is column-major: row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; i++)
+            rows[i] = glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]);
+
+        this->planes[0] = rows[3] + rows[0]; // Left
+        this->planes[1] = rows[3] - rows[0]; // Right
+        this->planes[2] = rows[3] + rows[1]; // Bottom
+        this->planes[3] = rows[3] - rows[1]; // Top
+        this->planes[4] = rows[3] + rows[2]; // Near
+        this->planes[5] = rows[3] - rows[2]; // Far
+    }
+
+    // False only if the box is entirely outside one plane; boxes straddling
+    // a frustum corner may pass, which is conservative.
+    bool intersects(const glm::vec3 &min, const glm::vec3 &max) const {
+        for (const glm::vec4 &plane : this->planes) {
+            // The box corner furthest along the plane normal
+            glm::vec3 corner(plane.x > 0 ? max.x : min.x,
+                             plane.y > 0 ? max.y : min.y,
+                             plane.z > 0 ? max.z : min.z);
+            float distance = plane.x * corner.x + plane.y * corner.y +
+                             plane.z * corner.z + plane.w;
+            if (distance < 0)
+                return false;
+        }
+        return true;
+    }
+};
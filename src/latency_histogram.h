@@ -0,0 +1,42 @@
+// latency_histogram.h
+#pragma once
+#include <algorithm>
+#include <cmath>
+
+// Log2-bucketed latency histogram. Bucket i counts samples in
+// [2^i, 2^(i+1)) microseconds; the first and last buckets are open-ended.
+struct LatencyHistogram {
+    static constexpr int BUCKETS = 20;
+
+    int counts[BUCKETS] = {};
+    int total = 0;
+    double max_us = 0.0;
+
+    void record(double seconds) {
+        double us = seconds * 1e6;
+        int bucket = us < 1.0 ? 0 : (int)std::log2(us);
+        this->counts[std::min(bucket, BUCKETS - 1)]++;
+        this->total++;
+        this->max_us = std::max(this->max_us, us);
+    }
+
+    // Upper bound in microseconds of the bucket holding percentile p
+    double percentile(double p) const {
+        int target = (int)std::ceil(p * this->total);
+        int seen = 0;
+        for (int i = 0; i < BUCKETS; i++) {
+            seen += this->counts[i];
+            if (seen >= target && seen > 0)
+                return std::ldexp(1.0, i + 1);
+        }
+        return 0.0;
+    }
+
+    // Bucket counts as floats, for ImGui::PlotHistogram
+    void values(float out[BUCKETS]) const {
+        for (int i = 0; i < BUCKETS; i++)
+            out[i] = (float)this->counts[i];
+    }
+
+    void reset() { *this = LatencyHistogram(); }
+};
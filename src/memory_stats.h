@@ -0,0 +1,32 @@
+// memory_stats.h
+#pragma once
+#include <cstddef>
+#include <cstdio>
+#ifdef __APPLE__
+#include <mach/mach.h>
+#else
+#include <unistd.h>
+#endif
+
+// Resident set size of the process in bytes, 0 if unavailable.
+inline size_t resident_set_bytes() {
+#ifdef __APPLE__
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO,
+                  (task_info_t)&info, &count) != KERN_SUCCESS)
+        return 0;
+    return info.resident_size;
+#else
+    // Second field of statm is resident pages
+    FILE *file = std::fopen("/proc/self/statm", "r");
+    if (!file)
+        return 0;
+    unsigned long pages = 0, resident = 0;
+    int read = std::fscanf(file, "%lu %lu", &pages, &resident);
+    std::fclose(file);
+    if (read != 2)
+        return 0;
+    return resident * (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
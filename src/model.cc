@@ -1,25 +1,90 @@
 // model.cc
 #include "assimp/material.h"
-#include "stb_image.h"
 #include "model.h"
+#include "textures.h"
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <cassert>
 
+// Builds the mip chain of an RGBA image and block compresses every level,
+// BC1 when it is opaque and BC3 otherwise. This runs on the cold load, so
+// BC7 is left out: it encodes about 15x slower than BC3 and the GL 4.1
+// context does not guarantee BPTC.
+static void compress_embedded_texture(std::vector<unsigned char> &rgba,
+                                      int width, int height,
+                                      TextureData &out) {
+    bool opaque = true;
+    for (size_t i = 3; i < rgba.size(); i += 4)
+        opaque &= rgba[i] == 255;
+    out.width = width;
+    out.height = height;
+    out.format = opaque ? TextureFormat::BC1 : TextureFormat::BC3;
+    out.levels = ModelCache::mip_levels(width, height);
+    out.pixels.resize(ModelCache::mip_chain_bytes(out.format, width, height,
+                                                  out.levels));
+
+    std::vector<unsigned char> next;
+    unsigned char *blocks = out.pixels.data();
+    for (int level = 0; level < out.levels; level++) {
+        compress_texture(out.format, rgba.data(), width, height, blocks);
+        blocks += texture_bytes(out.format, width, height);
+        if (level + 1 == out.levels)
+            break;
+        next.resize((size_t)std::max(width / 2, 1) *
+                    std::max(height / 2, 1) * 4);
+        downsample_texture(rgba.data(), width, height, next.data());
+        rgba.swap(next);
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+    }
+}
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+// Loads from "<filename>.cache" when it matches the file, otherwise
+// imports with Assimp and writes the cache for the next run
 Model::Model(const std::string &filename) {
     this->filename = filename;
+    auto start = std::chrono::steady_clock::now();
+    std::string cache_path = filename + ".cache";
+    ModelCache::Key key;
+    bool keyed = ModelCache::source_key(filename, IMPORT_FLAGS, key);
+    ModelCache cache;
+    if (keyed && cache.open(cache_path, key)) {
+        this->load_cache(cache);
+        std::cout << "Loaded " << filename << ": " << this->meshes.size()
+                  << " meshes, " << this->textures.size()
+                  << " textures, warm from " << cache_path << " in "
+                  << elapsed_ms(start) << " ms (cold "
+                  << cache.import_ms() << " ms)\n";
+        return;
+    }
+
+    std::vector<MeshData> mesh_data;
+    std::vector<TextureData> texture_data;
     this->load_scene();
-    this->build_meshes();
+    if (!this->build_meshes(mesh_data, texture_data))
+        return;
+    double cold_ms = elapsed_ms(start);
+    std::cout << "Loaded " << filename << ": " << this->meshes.size()
+              << " meshes, " << this->textures.size()
+              << " textures, cold with Assimp in " << cold_ms << " ms\n";
+    if (keyed) {
+        ModelCache::write(cache_path, key, (float)cold_ms, mesh_data,
+                          texture_data);
+    }
 }
 
 void Model::load_scene() {
-    const aiScene *scene = importer.ReadFile(
-        filename, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices |
-                      aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace |
-                      aiProcess_FlipUVs | aiProcess_LimitBoneWeights |
-                      aiProcess_OptimizeMeshes | aiProcess_OptimizeGraph);
+    const aiScene *scene = importer.ReadFile(filename, IMPORT_FLAGS);
 
     if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE ||
         !scene->mRootNode) {
@@ -30,132 +95,129 @@ void Model::load_scene() {
     this->scene = const_cast<aiScene *>(scene);
 }
 
-void Model::load_embedded_texture(const aiTexture *texture, GLuint &texID) {
-    std::cout << "Loading embedded texture: mHeight=" << texture->mHeight
+bool Model::decode_embedded_texture(const aiTexture *texture,
+                                    TextureData &out) {
+    std::cout << "Decoding embedded texture: mHeight=" << texture->mHeight
               << " mWidth=" << texture->mWidth << "\n";
 
-    glGenTextures(1, &texID);
-    glBindTexture(GL_TEXTURE_2D, texID);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                    GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    unsigned char *image = nullptr;
-    int width = 0, height = 0, channels = 0;
-    bool needsFree = false;
-
     if (texture->mHeight == 0 && texture->pcData) {
         std::cout << "  Compressed texture, size=" << texture->mWidth
                   << " bytes\n";
-        image = stbi_load_from_memory(
+        int width = 0, height = 0, channels = 0;
+        unsigned char *image = stbi_load_from_memory(
             reinterpret_cast<unsigned char *>(texture->pcData), texture->mWidth,
-            &width, &height, &channels, 0);
-        if (image) {
-            std::cout << "  Decompressed to: " << width << "x" << height
-                      << " channels=" << channels << "\n";
+            &width, &height, &channels, 4);
+        if (!image) {
+            std::cerr << "Failed to load embedded texture\n";
+            return false;
         }
-        needsFree = true;
-    } else if (texture->mHeight > 0 && texture->pcData) {
-        width = texture->mWidth;
-        height = texture->mHeight;
-        channels = 4;
-
+        std::cout << "  Decompressed to: " << width << "x" << height
+                  << " channels=" << channels << "\n";
+        std::vector<unsigned char> rgba(image,
+                                        image + (size_t)width * height * 4);
+        stbi_image_free(image);
+        compress_embedded_texture(rgba, width, height, out);
+        return true;
+    }
+    if (texture->mHeight > 0 && texture->pcData) {
+        int width = texture->mWidth;
+        int height = texture->mHeight;
         std::cout << "  Uncompressed texture: " << width << "x" << height
                   << "\n";
 
         if (width <= 0 || height <= 0 || width > 16384 || height > 16384) {
             std::cerr << "Invalid texture dimensions: " << width << "x"
                       << height << "\n";
-            glBindTexture(GL_TEXTURE_2D, 0);
-            return;
+            return false;
         }
 
-        image = new unsigned char[width * height * 4];
+        std::vector<unsigned char> rgba((size_t)width * height * 4);
         const aiTexel *texels = texture->pcData;
-
         for (int i = 0; i < width * height; ++i) {
-            image[i * 4 + 0] = texels[i].r;
-            image[i * 4 + 1] = texels[i].g;
-            image[i * 4 + 2] = texels[i].b;
-            image[i * 4 + 3] = texels[i].a;
+            rgba[i * 4 + 0] = texels[i].r;
+            rgba[i * 4 + 1] = texels[i].g;
+            rgba[i * 4 + 2] = texels[i].b;
+            rgba[i * 4 + 3] = texels[i].a;
         }
-        needsFree = true;
+        compress_embedded_texture(rgba, width, height, out);
+        return true;
     }
+    std::cerr << "Failed to load embedded texture\n";
+    return false;
+}
 
-    if (!image) {
-        std::cerr << "Failed to load embedded texture\n";
-        glBindTexture(GL_TEXTURE_2D, 0);
-        return;
+GLuint Model::upload_texture(const unsigned char *data, int width,
+                             int height, TextureFormat format, int levels) {
+    GLenum compressed =
+        is_block_compressed(format) ? compressed_texture_format(format) : 0;
+    if (is_block_compressed(format) && !compressed) {
+        std::cerr << "No GPU support for " << texture_format_name(format)
+                  << ", decoding model texture to RGBA8\n";
     }
 
-    GLenum format, internalFormat;
-    switch (channels) {
-    case 1:
-        format = GL_RED;
-        internalFormat = GL_R8;
-        break;
-    case 2:
-        format = GL_RG;
-        internalFormat = GL_RG8;
-        break;
-    case 3:
-        format = GL_RGB;
-        internalFormat = GL_RGB8;
-        break;
-    case 4:
-        format = GL_RGBA;
-        internalFormat = GL_RGBA8;
-        break;
-    default:
-        std::cerr << "Unsupported channel count: " << channels << "\n";
-        if (needsFree) {
-            if (texture->mHeight > 0)
-                delete[] image;
-            else
-                stbi_image_free(image);
+    GLuint texID;
+    glGenTextures(1, &texID);
+    glBindTexture(GL_TEXTURE_2D, texID);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                    GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+    // glGenerateMipmap cannot fill compressed levels, so the whole chain
+    // comes from the cache
+    std::vector<unsigned char> rgba;
+    for (int level = 0; level < levels; level++) {
+        int level_width = std::max(width >> level, 1);
+        int level_height = std::max(height >> level, 1);
+        size_t bytes = texture_bytes(format, level_width, level_height);
+        if (compressed) {
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, compressed,
+                                   level_width, level_height, 0,
+                                   (GLsizei)bytes, data);
+        } else {
+            const unsigned char *pixels = data;
+            if (is_block_compressed(format)) {
+                rgba.resize((size_t)level_width * level_height * 4);
+                decompress_texture(format, data, level_width, level_height,
+                                   rgba.data());
+                pixels = rgba.data();
+            }
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, level_width,
+                         level_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
         }
-        glBindTexture(GL_TEXTURE_2D, 0);
-        return;
+        data += bytes;
     }
 
-    std::cout << "  Uploading to GPU: format=" << format
-              << " internal=" << internalFormat << "\n";
-    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format,
-                 GL_UNSIGNED_BYTE, image);
-
     GLenum err = glGetError();
     if (err != GL_NO_ERROR) {
-        std::cerr << "OpenGL error after glTexImage2D: " << err << "\n";
-    }
-
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    if (needsFree) {
-        if (texture->mHeight > 0)
-            delete[] image;
-        else
-            stbi_image_free(image);
+        std::cerr << "OpenGL error after texture upload: " << err << "\n";
     }
 
     glBindTexture(GL_TEXTURE_2D, 0);
-    std::cout << "  Texture loaded successfully, ID=" << texID << "\n";
+    return texID;
 }
 
-void Model::build_meshes() {
+bool Model::build_meshes(std::vector<MeshData> &mesh_data,
+                         std::vector<TextureData> &texture_data) {
     if (!scene)
-        return;
+        return false;
     meshes.clear();
+    textures.clear();
 
     const aiVector3D aiZero(0, 0, 0);
+    // Embedded texture -> index in texture_data, so meshes sharing one
+    // decode it once
+    std::vector<int> decoded(scene->mNumTextures, -1);
 
+    mesh_data.resize(scene->mNumMeshes);
     for (unsigned int m = 0; m < scene->mNumMeshes; ++m) {
         aiMesh *mesh = scene->mMeshes[m];
         aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
 
-        Mesh newMesh;
+        MeshData &newMesh = mesh_data[m];
         newMesh.vertices.reserve(mesh->mNumVertices);
         newMesh.indices.reserve(mesh->mNumFaces * 3);
 
@@ -186,25 +248,73 @@ void Model::build_meshes() {
             aiString str;
             material->GetTexture(aiTextureType_BASE_COLOR, 0, &str);
             const aiTexture *tex = scene->GetEmbeddedTexture(str.C_Str());
-            if (tex)
-                load_embedded_texture(tex, newMesh.diffuseTexture);
+            int index = (int)(std::find(scene->mTextures,
+                                        scene->mTextures + scene->mNumTextures,
+                                        tex) -
+                              scene->mTextures);
+            if (tex && index < (int)scene->mNumTextures) {
+                TextureData texture;
+                if (decoded[index] < 0 &&
+                    decode_embedded_texture(tex, texture)) {
+                    decoded[index] = (int)texture_data.size();
+                    texture_data.push_back(std::move(texture));
+                }
+                newMesh.texture = decoded[index];
+            }
         }
-        meshes.push_back(newMesh);
     }
-    for (Mesh &mesh : this->meshes) {
-        this->upload_to_gpu(mesh);
+    // Everything needed is in mesh_data and texture_data now
+    importer.FreeScene();
+    scene = nullptr;
+
+    for (const TextureData &texture : texture_data) {
+        this->textures.push_back(this->upload_texture(
+            texture.pixels.data(), texture.width, texture.height,
+            texture.format, texture.levels));
+    }
+    for (const MeshData &data : mesh_data) {
+        Mesh mesh;
+        this->upload_to_gpu(mesh, data.vertices.data(), data.vertices.size(),
+                            data.indices.data(), data.indices.size());
+        if (data.texture >= 0)
+            mesh.diffuseTexture = this->textures[data.texture];
+        this->meshes.push_back(mesh);
+    }
+    return true;
+}
+
+// Uploads straight from the mapped file; nothing is copied on the CPU
+void Model::load_cache(const ModelCache &cache) {
+    meshes.clear();
+    textures.clear();
+    for (int i = 0; i < cache.texture_count(); i++) {
+        const ModelCache::TextureEntry &entry = cache.texture(i);
+        this->textures.push_back(this->upload_texture(
+            cache.pixels(i), entry.width, entry.height,
+            (TextureFormat)entry.format, entry.levels));
+    }
+    for (int i = 0; i < cache.mesh_count(); i++) {
+        const ModelCache::MeshEntry &entry = cache.mesh(i);
+        Mesh mesh;
+        this->upload_to_gpu(mesh, cache.vertices(i), entry.vertex_count,
+                            cache.indices(i), entry.index_count);
+        if (entry.texture >= 0)
+            mesh.diffuseTexture = this->textures[entry.texture];
+        this->meshes.push_back(mesh);
     }
-    std::cout << "Loaded " << meshes.size() << " meshes.\n";
 }
-void Model::upload_to_gpu(Mesh &mesh) {
+
+void Model::upload_to_gpu(Mesh &mesh, const Vertex *vertices,
+                          size_t vertexCount, const uint32_t *indices,
+                          size_t indexCount) {
     glGenVertexArrays(1, &mesh.vao);
     glGenBuffers(1, &mesh.vbo);
     glGenBuffers(1, &mesh.ebo);
 
     glBindVertexArray(mesh.vao);
     glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
-    glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(Vertex),
-                 mesh.vertices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertices,
+                 GL_STATIC_DRAW);
 
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
@@ -217,22 +327,21 @@ void Model::upload_to_gpu(Mesh &mesh) {
                           (void *)offsetof(Vertex, normal));
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-                 mesh.indices.size() * sizeof(uint32_t), mesh.indices.data(),
-                 GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(uint32_t),
+                 indices, GL_STATIC_DRAW);
     glBindVertexArray(0);
+    mesh.indexCount = (GLsizei)indexCount;
 }
 
 void Model::render() {
     glActiveTexture(
-        GL_TEXTURE10); // Use unit 10, away from your 0-6 block textures
+        GL_TEXTURE15); // Use unit 15, away from the block texture array
 
     for (auto &mesh : meshes) {
         if (mesh.diffuseTexture) {
             glBindTexture(GL_TEXTURE_2D, mesh.diffuseTexture);
         }
         glBindVertexArray(mesh.vao);
-        glDrawElements(GL_TRIANGLES, (GLsizei)mesh.indices.size(),
-                       GL_UNSIGNED_INT, 0);
+        glDrawElements(GL_TRIANGLES, mesh.indexCount, GL_UNSIGNED_INT, 0);
     }
 }
@@ -4,27 +4,29 @@
 #include <vector>
 #include "assimp/anim.h"
 #include "glad.h"
+#include "model_cache.h"
 #include <glm/glm.hpp>
 #include <assimp/scene.h>
 #include <assimp/Importer.hpp>
-
-struct Vertex {
-    glm::vec3 position;
-    glm::vec2 texCoords;
-    glm::vec3 normal;
-};
+#include <assimp/postprocess.h>
 
 struct Mesh {
-    std::vector<Vertex> vertices;
-    std::vector<uint32_t> indices;
     GLuint vao = 0;
     GLuint vbo = 0;
     GLuint ebo = 0;
+    GLsizei indexCount = 0;
     GLuint diffuseTexture = 0;
 };
 
 class Model {
   public:
+    // Post-processing applied on import; part of the cache key
+    static constexpr unsigned IMPORT_FLAGS =
+        aiProcess_Triangulate | aiProcess_JoinIdenticalVertices |
+        aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace |
+        aiProcess_FlipUVs | aiProcess_LimitBoneWeights |
+        aiProcess_OptimizeMeshes | aiProcess_OptimizeGraph;
+
     Model(const std::string &filename);
     ~Model() = default;
 
@@ -35,10 +37,21 @@ class Model {
     aiScene *scene = nullptr;
 
     std::vector<Mesh> meshes;
+    // Shared by the meshes that sample them
+    std::vector<GLuint> textures;
 
     void load_scene();
-    void build_meshes();
-    void upload_to_gpu(Mesh& mesh);
-    void load_embedded_texture(const aiTexture *texture, GLuint &texID);
+    // Converts the scene and uploads it; false if there is no scene
+    bool build_meshes(std::vector<MeshData> &mesh_data,
+                      std::vector<TextureData> &texture_data);
+    void load_cache(const ModelCache &cache);
+    void upload_to_gpu(Mesh &mesh, const Vertex *vertices,
+                       size_t vertexCount, const uint32_t *indices,
+                       size_t indexCount);
+    bool decode_embedded_texture(const aiTexture *texture,
+                                 TextureData &out);
+    // Uploads a mip chain, decoding BCn to RGBA8 if the GPU cannot
+    // sample it compressed
+    GLuint upload_texture(const unsigned char *data, int width, int height,
+                          TextureFormat format, int levels);
 };
-
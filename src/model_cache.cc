@@ -0,0 +1,203 @@
+// model_cache.cc
+#include "model_cache.h"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static size_t align16(size_t offset) { return (offset + 15) & ~(size_t)15; }
+
+// Maps a whole file read-only; nullptr if it is missing or empty
+static const unsigned char *map_file(const std::string &path, size_t &bytes) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    const unsigned char *mapping = nullptr;
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            mapping = (const unsigned char *)data;
+            bytes = info.st_size;
+        }
+    }
+    ::close(fd);
+    return mapping;
+}
+
+// 64-bit multiply-xorshift over 8-byte words; models are megabytes, so
+// hashing byte by byte would cost more than the warm load itself
+static uint64_t hash_bytes(const unsigned char *data, size_t bytes) {
+    constexpr uint64_t PRIME = 0x9E3779B97F4A7C15ull;
+    uint64_t hash = bytes * PRIME;
+    size_t i = 0;
+    for (; i + 8 <= bytes; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * PRIME;
+        hash ^= hash >> 29;
+    }
+    for (; i < bytes; i++) {
+        hash = (hash ^ data[i]) * PRIME;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+bool ModelCache::source_key(const std::string &path, uint32_t import_flags,
+                            Key &key) {
+    size_t bytes = 0;
+    const unsigned char *data = map_file(path, bytes);
+    if (!data)
+        return false;
+    key.source_size = bytes;
+    key.source_hash = hash_bytes(data, bytes);
+    key.import_flags = import_flags;
+    munmap((void *)data, bytes);
+    return true;
+}
+
+bool ModelCache::write(const std::string &path, const Key &key,
+                       float import_ms, const std::vector<MeshData> &meshes,
+                       const std::vector<TextureData> &textures) {
+    Header header = {MAGIC,
+                     VERSION,
+                     (uint32_t)sizeof(Vertex),
+                     key.import_flags,
+                     key.source_size,
+                     key.source_hash,
+                     (uint32_t)meshes.size(),
+                     (uint32_t)textures.size(),
+                     import_ms,
+                     0};
+    std::vector<MeshEntry> mesh_entries(meshes.size());
+    std::vector<TextureEntry> texture_entries(textures.size());
+    size_t offset = sizeof(Header) + meshes.size() * sizeof(MeshEntry) +
+                    textures.size() * sizeof(TextureEntry);
+    for (size_t i = 0; i < meshes.size(); i++) {
+        MeshEntry &entry = mesh_entries[i];
+        entry = {};
+        entry.vertex_offset = align16(offset);
+        entry.vertex_count = (uint32_t)meshes[i].vertices.size();
+        offset = entry.vertex_offset + entry.vertex_count * sizeof(Vertex);
+        entry.index_offset = align16(offset);
+        entry.index_count = (uint32_t)meshes[i].indices.size();
+        offset = entry.index_offset + entry.index_count * sizeof(uint32_t);
+        entry.texture = meshes[i].texture;
+    }
+    for (size_t i = 0; i < textures.size(); i++) {
+        TextureEntry &entry = texture_entries[i];
+        entry = {};
+        entry.offset = align16(offset);
+        entry.width = textures[i].width;
+        entry.height = textures[i].height;
+        entry.format = (uint32_t)textures[i].format;
+        entry.levels = textures[i].levels;
+        offset = entry.offset + textures[i].pixels.size();
+    }
+
+    std::vector<unsigned char> data(offset, 0);
+    std::memcpy(data.data(), &header, sizeof(header));
+    unsigned char *out = data.data() + sizeof(header);
+    std::memcpy(out, mesh_entries.data(), meshes.size() * sizeof(MeshEntry));
+    out += meshes.size() * sizeof(MeshEntry);
+    std::memcpy(out, texture_entries.data(),
+                textures.size() * sizeof(TextureEntry));
+    for (size_t i = 0; i < meshes.size(); i++) {
+        const MeshEntry &entry = mesh_entries[i];
+        std::memcpy(data.data() + entry.vertex_offset,
+                    meshes[i].vertices.data(),
+                    entry.vertex_count * sizeof(Vertex));
+        std::memcpy(data.data() + entry.index_offset,
+                    meshes[i].indices.data(),
+                    entry.index_count * sizeof(uint32_t));
+    }
+    for (size_t i = 0; i < textures.size(); i++) {
+        std::memcpy(data.data() + texture_entries[i].offset,
+                    textures[i].pixels.data(), textures[i].pixels.size());
+    }
+
+    std::string temporary = path + ".tmp";
+    FILE *file = std::fopen(temporary.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Failed to write model cache: " << path << std::endl;
+        return false;
+    }
+    bool written = std::fwrite(data.data(), 1, data.size(), file) ==
+                   data.size();
+    if (std::fclose(file) != 0 || !written ||
+        std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::cerr << "Failed to write model cache: " << path << std::endl;
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool ModelCache::open(const std::string &path, const Key &key) {
+    this->close();
+    this->mapping = map_file(path, this->mapped_bytes);
+    if (!this->mapping)
+        return false;
+    if (!this->valid(key)) {
+        this->close();
+        return false;
+    }
+    return true;
+}
+
+void ModelCache::close() {
+    if (this->mapping)
+        munmap((void *)this->mapping, this->mapped_bytes);
+    this->mapping = nullptr;
+    this->mapped_bytes = 0;
+}
+
+bool ModelCache::valid(const Key &key) const {
+    if (this->mapped_bytes < sizeof(Header))
+        return false;
+    const Header &header = this->header();
+    if (header.magic != MAGIC || header.version != VERSION ||
+        header.vertex_size != sizeof(Vertex) ||
+        header.import_flags != key.import_flags ||
+        header.source_size != key.source_size ||
+        header.source_hash != key.source_hash)
+        return false;
+    size_t tables = sizeof(Header) +
+                    (size_t)header.meshes * sizeof(MeshEntry) +
+                    (size_t)header.textures * sizeof(TextureEntry);
+    if (tables > this->mapped_bytes)
+        return false;
+
+    // Every array inside the file, so a damaged cache cannot send reads
+    // past the mapping
+    auto fits = [&](uint64_t offset, uint64_t bytes) {
+        return offset % 16 == 0 && offset >= tables &&
+               offset <= this->mapped_bytes &&
+               bytes <= this->mapped_bytes - offset;
+    };
+    for (int i = 0; i < this->mesh_count(); i++) {
+        const MeshEntry &entry = this->mesh(i);
+        if (!fits(entry.vertex_offset,
+                  (uint64_t)entry.vertex_count * sizeof(Vertex)) ||
+            !fits(entry.index_offset,
+                  (uint64_t)entry.index_count * sizeof(uint32_t)) ||
+            entry.texture >= (int32_t)header.textures)
+            return false;
+    }
+    for (int i = 0; i < this->texture_count(); i++) {
+        const TextureEntry &entry = this->texture(i);
+        if (entry.width < 1 || entry.width > 16384 || entry.height < 1 ||
+            entry.height > 16384 ||
+            entry.format > (uint32_t)TextureFormat::BC7 ||
+            entry.levels != (uint32_t)mip_levels(entry.width, entry.height) ||
+            !fits(entry.offset,
+                  mip_chain_bytes((TextureFormat)entry.format, entry.width,
+                                  entry.height, entry.levels)))
+            return false;
+    }
+    return true;
+}
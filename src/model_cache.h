@@ -0,0 +1,152 @@
+// model_cache.h
+#pragma once
+#include "block_compression.h"
+#include <algorithm>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+struct Vertex {
+    glm::vec3 position;
+    glm::vec2 texCoords;
+    glm::vec3 normal;
+};
+
+// A mesh as Model builds it from an Assimp scene, before upload
+struct MeshData {
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    int texture = -1; // index into the model's textures, -1 for none
+};
+
+// An embedded texture ready for upload: `levels` mip levels from the
+// largest down, back to back, each RGBA8 rows or BCn blocks per `format`
+struct TextureData {
+    int width = 0;
+    int height = 0;
+    TextureFormat format = TextureFormat::RGBA8;
+    int levels = 0;
+    std::vector<unsigned char> pixels;
+};
+
+// What Model builds from a scene, saved next to the source as
+// "<model>.cache" so later runs skip Assimp, the PNG/JPEG decodes and the
+// block compression, and hand the mapped arrays straight to glBufferData
+// and glCompressedTexImage2D.
+//
+// Layout: the Header, one MeshEntry per mesh, one TextureEntry per
+// texture, then the arrays they point at, each 16-byte aligned. The
+// header records the source file's size and hash and the Assimp flags it
+// was imported with; open() rejects a cache that no longer matches.
+struct ModelCache {
+    static constexpr uint32_t MAGIC = 0x43444D56; // "VMDC"
+    static constexpr uint32_t VERSION = 2;
+
+    struct Key {
+        uint64_t source_size = 0;
+        uint64_t source_hash = 0;
+        uint32_t import_flags = 0;
+    };
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t vertex_size; // sizeof(Vertex)
+        uint32_t import_flags;
+        uint64_t source_size;
+        uint64_t source_hash;
+        uint32_t meshes;
+        uint32_t textures;
+        float import_ms; // Assimp import and decode time of the cold load
+        uint32_t reserved;
+    };
+    struct MeshEntry {
+        uint64_t vertex_offset;
+        uint64_t index_offset;
+        uint32_t vertex_count;
+        uint32_t index_count;
+        int32_t texture;
+        uint32_t reserved;
+    };
+    struct TextureEntry {
+        uint64_t offset;
+        uint32_t width;
+        uint32_t height;
+        uint32_t format; // TextureFormat
+        uint32_t levels;
+    };
+
+    // Full chain down to 1x1
+    static int mip_levels(int width, int height) {
+        int levels = 1;
+        while (width > 1 || height > 1) {
+            width /= 2;
+            height /= 2;
+            levels++;
+        }
+        return levels;
+    }
+    static size_t mip_chain_bytes(TextureFormat format, int width, int height,
+                                  int levels) {
+        size_t bytes = 0;
+        for (int level = 0; level < levels; level++) {
+            bytes += texture_bytes(format, std::max(width >> level, 1),
+                                   std::max(height >> level, 1));
+        }
+        return bytes;
+    }
+
+    ModelCache() = default;
+    ~ModelCache() { this->close(); }
+    ModelCache(const ModelCache &) = delete;
+    ModelCache &operator=(const ModelCache &) = delete;
+
+    // Hashes the source file; false if it cannot be read
+    static bool source_key(const std::string &path, uint32_t import_flags,
+                           Key &key);
+    // Writes the cache through a temporary file, so an interrupted write
+    // never leaves a truncated cache behind
+    static bool write(const std::string &path, const Key &key,
+                      float import_ms, const std::vector<MeshData> &meshes,
+                      const std::vector<TextureData> &textures);
+
+    // Maps the cache read-only; false if it is missing, malformed or was
+    // built from another source or with other flags
+    bool open(const std::string &path, const Key &key);
+    void close();
+
+    bool is_open() const { return this->mapping != nullptr; }
+    size_t file_size() const { return this->mapped_bytes; }
+    float import_ms() const { return this->header().import_ms; }
+    int mesh_count() const { return this->header().meshes; }
+    int texture_count() const { return this->header().textures; }
+    const MeshEntry &mesh(int i) const { return this->mesh_entries()[i]; }
+    const TextureEntry &texture(int i) const {
+        return this->texture_entries()[i];
+    }
+    const Vertex *vertices(int mesh) const {
+        return (const Vertex *)(this->mapping +
+                                this->mesh(mesh).vertex_offset);
+    }
+    const uint32_t *indices(int mesh) const {
+        return (const uint32_t *)(this->mapping +
+                                  this->mesh(mesh).index_offset);
+    }
+    const unsigned char *pixels(int texture) const {
+        return this->mapping + this->texture(texture).offset;
+    }
+
+  private:
+    const unsigned char *mapping = nullptr;
+    size_t mapped_bytes = 0;
+
+    const Header &header() const { return *(const Header *)this->mapping; }
+    const MeshEntry *mesh_entries() const {
+        return (const MeshEntry *)(this->mapping + sizeof(Header));
+    }
+    const TextureEntry *texture_entries() const {
+        return (const TextureEntry *)(this->mesh_entries() +
+                                      this->header().meshes);
+    }
+    bool valid(const Key &key) const;
+};
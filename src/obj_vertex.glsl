@@ -4,9 +4,11 @@ layout (location = 1) in vec2 aTexCoord;
 layout (location = 2) in vec3 aNormal;   
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform float time;
+layout(std140) uniform Frame { // see FrameUniforms
+    mat4 view;
+    mat4 projection;
+    float time;
+};
 
 out vec2 TexCoord;
 
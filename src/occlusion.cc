@@ -0,0 +1,175 @@
+// occlusion.cc
+#include "occlusion.h"
+#include <algorithm>
+#include <cmath>
+
+// Boxes reaching this close to the eye plane are neither drawn as occluders
+// nor culled, which avoids clipping triangles against the near plane.
+static constexpr float MIN_W = 1e-3f;
+
+void OcclusionCuller::begin(const glm::mat4 &clip) {
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 4; row++)
+            this->clip[column][row] = clip[column][row];
+    }
+    for (int level = 0; level < LEVELS; level++)
+        this->levels[level].assign((WIDTH >> level) * (HEIGHT >> level), 1.0f);
+}
+
+OcclusionCuller::Projected OcclusionCuller::project(float x, float y,
+                                                    float z) const {
+    const float(*m)[4] = this->clip;
+    float cx = m[0][0] * x + m[1][0] * y + m[2][0] * z + m[3][0];
+    float cy = m[0][1] * x + m[1][1] * y + m[2][1] * z + m[3][1];
+    float cz = m[0][2] * x + m[1][2] * y + m[2][2] * z + m[3][2];
+    float cw = m[0][3] * x + m[1][3] * y + m[2][3] * z + m[3][3];
+    if (cw < MIN_W)
+        return {0, 0, 0, cw};
+    float inv = 1.0f / cw;
+    return {(cx * inv * 0.5f + 0.5f) * WIDTH,
+            (cy * inv * 0.5f + 0.5f) * HEIGHT, cz * inv, cw};
+}
+
+// Box corner i has bit 0 = max x, bit 1 = max y, bit 2 = max z; triangles
+// wind counter-clockwise seen from outside
+static constexpr int box_triangles[12][3] = {
+    {0, 6, 2}, {0, 4, 6}, {1, 7, 5}, {1, 3, 7}, // -x, +x
+    {0, 5, 4}, {0, 1, 5}, {2, 7, 3}, {2, 6, 7}, // -y, +y
+    {0, 3, 1}, {0, 2, 3}, {4, 7, 6}, {4, 5, 7}}; // -z, +z
+
+void OcclusionCuller::add_occluder(const glm::vec3 &min,
+                                   const glm::vec3 &max) {
+    Projected corners[8];
+    for (int i = 0; i < 8; i++) {
+        corners[i] = this->project(i & 1 ? max.x : min.x, i & 2 ? max.y : min.y,
+                                   i & 4 ? max.z : min.z);
+        if (corners[i].w < MIN_W)
+            return;
+    }
+    for (const int *triangle : box_triangles) {
+        this->rasterize_triangle(corners[triangle[0]], corners[triangle[1]],
+                                 corners[triangle[2]]);
+    }
+}
+
+// Half-space rasterizer sampling pixel centers. Depth is the plane's
+// farthest value over the pixel so an occluder never claims to be nearer
+// than it is.
+void OcclusionCuller::rasterize_triangle(const Projected &a,
+                                         const Projected &b,
+                                         const Projected &c) {
+    // Back faces of a box lie behind its front faces; skip them
+    float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    if (area < 1e-6f)
+        return;
+
+    int x0 = std::max(0, (int)std::floor(std::min({a.x, b.x, c.x})));
+    int x1 = std::min(WIDTH - 1, (int)std::ceil(std::max({a.x, b.x, c.x})));
+    int y0 = std::max(0, (int)std::floor(std::min({a.y, b.y, c.y})));
+    int y1 = std::min(HEIGHT - 1, (int)std::ceil(std::max({a.y, b.y, c.y})));
+    if (x0 > x1 || y0 > y1)
+        return;
+
+    // Edge functions e(x, y) = ex * x + ey * y + e0, positive inside
+    float e[3][3];
+    const Projected *v[3] = {&a, &b, &c};
+    for (int i = 0; i < 3; i++) {
+        const Projected &from = *v[i];
+        const Projected &to = *v[(i + 1) % 3];
+        e[i][0] = -(to.y - from.y);
+        e[i][1] = to.x - from.x;
+        e[i][2] = -(e[i][0] * from.x + e[i][1] * from.y);
+    }
+
+    // Depth plane z(x, y) = zx * x + zy * y + z0
+    float zx = ((b.z - a.z) * (c.y - a.y) - (c.z - a.z) * (b.y - a.y)) / area;
+    float zy = ((c.z - a.z) * (b.x - a.x) - (b.z - a.z) * (c.x - a.x)) / area;
+    float z0 = a.z - zx * a.x - zy * a.y +
+               0.5f * (std::fabs(zx) + std::fabs(zy));
+
+    // Each row covers the pixel centers inside all three edges, found by
+    // solving the edge functions for x; the span loop is then a plain min
+    // that the compiler vectorizes.
+    float *depth = this->levels[0].data();
+    for (int y = y0; y <= y1; y++) {
+        float py = y + 0.5f;
+        float left = x0 + 0.5f, right = x1 + 0.5f;
+        for (const float *edge : e) {
+            float offset = edge[1] * py + edge[2];
+            if (edge[0] > 0)
+                left = std::max(left, -offset / edge[0]);
+            else if (edge[0] < 0)
+                right = std::min(right, -offset / edge[0]);
+            else if (offset < 0)
+                right = -1.0f;
+        }
+        if (left > right)
+            continue;
+        int first = (int)std::ceil(left - 0.5f);
+        int last = (int)std::floor(right - 0.5f);
+        float *row = depth + y * WIDTH;
+        float z = zx * (first + 0.5f) + zy * py + z0;
+        for (int x = first; x <= last; x++)
+            row[x] = std::min(row[x], z + zx * (x - first));
+    }
+}
+
+void OcclusionCuller::finish() {
+    for (int level = 1; level < LEVELS; level++) {
+        int width = WIDTH >> level;
+        int height = HEIGHT >> level;
+        const float *src = this->levels[level - 1].data();
+        float *dst = this->levels[level].data();
+        for (int y = 0; y < height; y++) {
+            const float *top = src + (2 * y) * (2 * width);
+            const float *bottom = top + 2 * width;
+            for (int x = 0; x < width; x++) {
+                dst[y * width + x] =
+                    std::max(std::max(top[2 * x], top[2 * x + 1]),
+                             std::max(bottom[2 * x], bottom[2 * x + 1]));
+            }
+        }
+    }
+}
+
+bool OcclusionCuller::is_visible(const glm::vec3 &min,
+                                 const glm::vec3 &max) const {
+    float x0 = INFINITY, y0 = INFINITY, x1 = -INFINITY, y1 = -INFINITY;
+    float nearest = 1.0f;
+    for (int i = 0; i < 8; i++) {
+        Projected p = this->project(i & 1 ? max.x : min.x,
+                                    i & 2 ? max.y : min.y,
+                                    i & 4 ? max.z : min.z);
+        if (p.w < MIN_W)
+            return true;
+        x0 = std::min(x0, p.x);
+        y0 = std::min(y0, p.y);
+        x1 = std::max(x1, p.x);
+        y1 = std::max(y1, p.y);
+        nearest = std::min(nearest, p.z);
+    }
+
+    // One pixel of margin covers pixels the occluders only partly cover
+    int px0 = std::max(0, (int)std::floor(x0) - 1);
+    int py0 = std::max(0, (int)std::floor(y0) - 1);
+    int px1 = std::min(WIDTH - 1, (int)std::floor(x1) + 1);
+    int py1 = std::min(HEIGHT - 1, (int)std::floor(y1) + 1);
+    if (px0 > px1 || py0 > py1)
+        return true;
+
+    // Coarsest level at which the rectangle spans at most 4x4 texels
+    int level = 0;
+    while (level < LEVELS - 1 && ((px1 >> level) - (px0 >> level) > 3 ||
+                                  (py1 >> level) - (py0 >> level) > 3))
+        level++;
+
+    int width = WIDTH >> level;
+    const float *depth = this->levels[level].data();
+    for (int y = py0 >> level; y <= py1 >> level; y++) {
+        for (int x = px0 >> level; x <= px1 >> level; x++) {
+            if (nearest <= depth[y * width + x])
+                return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,37 @@
+// occlusion.h
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+
+// Software occlusion culling. Boxes known to be solid are rasterized into a
+// small depth buffer, which is reduced into a max-depth (hierarchical-Z)
+// pyramid; a box is occluded if its nearest depth lies behind every pyramid
+// texel its screen rectangle touches. Depths are NDC z, which is linear in
+// screen space.
+struct OcclusionCuller {
+    static constexpr int WIDTH = 128;
+    static constexpr int HEIGHT = 64;
+    static constexpr int LEVELS = 7; // down to 2x1
+
+    // Clears the depth buffer for a new frame seen through `clip`
+    void begin(const glm::mat4 &clip);
+    // Rasterizes an axis-aligned box that is opaque throughout
+    void add_occluder(const glm::vec3 &min, const glm::vec3 &max);
+    // Builds the pyramid; call after the last occluder
+    void finish();
+    // False if the box is certainly hidden behind the occluders
+    bool is_visible(const glm::vec3 &min, const glm::vec3 &max) const;
+
+  private:
+    // Screen position in depth buffer pixels, NDC depth and clip w
+    struct Projected {
+        float x, y, z, w;
+    };
+
+    float clip[4][4];
+    std::vector<float> levels[LEVELS];
+
+    Projected project(float x, float y, float z) const;
+    void rasterize_triangle(const Projected &a, const Projected &b,
+                            const Projected &c);
+};
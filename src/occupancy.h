@@ -0,0 +1,55 @@
+// occupancy.h
+#pragma once
+#include <cstdint>
+#include <cstring>
+
+// One bit per voxel of a 32^3 chunk, kept in three orientations so runs
+// along any axis are a single word: cols_y[x][z] holds bit y of the column
+// at (x, z), rows_x[y][z] bit x and rows_z[x][y] bit z. Neighbor tests
+// become shifts, e.g. the top faces of a column are `col & ~(col >> 1)`.
+struct Occupancy {
+    static constexpr int SIZE = 32;
+
+    uint32_t cols_y[SIZE][SIZE];
+    uint32_t rows_x[SIZE][SIZE];
+    uint32_t rows_z[SIZE][SIZE];
+
+    Occupancy() { this->clear(); }
+
+    void clear() {
+        std::memset(this->cols_y, 0, sizeof(this->cols_y));
+        std::memset(this->rows_x, 0, sizeof(this->rows_x));
+        std::memset(this->rows_z, 0, sizeof(this->rows_z));
+    }
+
+    bool get(int x, int y, int z) const {
+        return (this->cols_y[x][z] >> y) & 1;
+    }
+
+    void set(int x, int y, int z, bool value) {
+        if (value) {
+            this->cols_y[x][z] |= 1u << y;
+            this->rows_x[y][z] |= 1u << x;
+            this->rows_z[x][y] |= 1u << z;
+        } else {
+            this->cols_y[x][z] &= ~(1u << y);
+            this->rows_x[y][z] &= ~(1u << x);
+            this->rows_z[x][y] &= ~(1u << z);
+        }
+    }
+
+    // Sets every voxel with bottom <= y <= top
+    void fill_layers(int bottom, int top) {
+        uint32_t bits = (uint32_t)((1ull << (top + 1)) - (1ull << bottom));
+        for (int a = 0; a < SIZE; a++) {
+            for (int b = 0; b < SIZE; b++)
+                this->cols_y[a][b] |= bits;
+        }
+        for (int y = bottom; y <= top; y++) {
+            for (int a = 0; a < SIZE; a++) {
+                this->rows_x[y][a] = ~0u;
+                this->rows_z[a][y] = ~0u;
+            }
+        }
+    }
+};
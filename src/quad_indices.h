@@ -0,0 +1,69 @@
+// quad_indices.h
+#pragma once
+#include "glad.h"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Index buffers shared by every chunk mesh. Quads are always emitted as
+// four consecutive vertices drawn as (0, 1, 2) and (0, 2, 3), so one
+// pattern serves all chunks and chunks upload vertices only. Meshes under
+// 65,536 vertices use the 16-bit buffer; larger ones use the 32-bit buffer,
+// which grows on demand.
+struct QuadIndices {
+    static constexpr size_t MAX_SHORT_QUADS = 65536 / 4;
+
+    uint short_ebo = 0, int_ebo = 0;
+    size_t int_quads = 0;
+
+    QuadIndices() {
+        glGenBuffers(1, &this->short_ebo);
+        glGenBuffers(1, &this->int_ebo);
+        std::vector<uint16_t> indices = build<uint16_t>(MAX_SHORT_QUADS);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->short_ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                     indices.size() * sizeof(uint16_t), indices.data(),
+                     GL_STATIC_DRAW);
+    }
+    ~QuadIndices() {
+        glDeleteBuffers(1, &this->short_ebo);
+        glDeleteBuffers(1, &this->int_ebo);
+    }
+    QuadIndices(const QuadIndices &) = delete;
+    QuadIndices &operator=(const QuadIndices &) = delete;
+
+    static GLenum index_type(size_t quads) {
+        return quads <= MAX_SHORT_QUADS ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    }
+
+    // Binds the buffer for a mesh of `quads` quads to the current VAO.
+    void bind(size_t quads) {
+        if (index_type(quads) == GL_UNSIGNED_SHORT) {
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->short_ebo);
+            return;
+        }
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->int_ebo);
+        if (quads <= this->int_quads)
+            return;
+
+        // Reallocating the same buffer name keeps it valid in every VAO
+        // that already references it.
+        this->int_quads = std::max(quads, this->int_quads * 2);
+        std::vector<uint32_t> indices = build<uint32_t>(this->int_quads);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                     indices.size() * sizeof(uint32_t), indices.data(),
+                     GL_STATIC_DRAW);
+    }
+
+  private:
+    template <typename T> static std::vector<T> build(size_t quads) {
+        std::vector<T> indices;
+        indices.reserve(quads * 6);
+        for (size_t quad = 0; quad < quads; quad++) {
+            T base = (T)(quad * 4);
+            indices.insert(indices.end(), {base, (T)(base + 1), (T)(base + 2),
+                                           base, (T)(base + 2), (T)(base + 3)});
+        }
+        return indices;
+    }
+};
@@ -0,0 +1,67 @@
+// range_allocator.h
+#pragma once
+#include <iterator>
+#include <map>
+
+// First-fit allocator over the units [0, capacity) of some buffer. Free
+// ranges are kept ordered by offset so a freed range merges with the free
+// ranges on either side of it.
+struct RangeAllocator {
+    explicit RangeAllocator(int capacity = 0) { this->grow(capacity); }
+
+    // Returns the offset of `size` free units, or -1 if no range fits
+    int allocate(int size) {
+        for (auto it = this->free_ranges.begin(); it != this->free_ranges.end();
+             it++) {
+            if (it->second < size)
+                continue;
+            int offset = it->first;
+            int rest = it->second - size;
+            this->free_ranges.erase(it);
+            if (rest)
+                this->free_ranges[offset + size] = rest;
+            this->used_units += size;
+            return offset;
+        }
+        return -1;
+    }
+
+    void free(int offset, int size) {
+        this->used_units -= size;
+        auto next = this->free_ranges.lower_bound(offset);
+        if (next != this->free_ranges.end() && offset + size == next->first) {
+            size += next->second;
+            next = this->free_ranges.erase(next);
+        }
+        if (next != this->free_ranges.begin()) {
+            auto prev = std::prev(next);
+            if (prev->first + prev->second == offset) {
+                prev->second += size;
+                return;
+            }
+        }
+        this->free_ranges[offset] = size;
+    }
+
+    // Extends the managed units to [0, capacity)
+    void grow(int capacity) {
+        if (capacity <= this->total_units)
+            return;
+        int added = capacity - this->total_units;
+        int offset = this->total_units;
+        this->total_units = capacity;
+        this->used_units += added;
+        this->free(offset, added);
+    }
+
+    int capacity() const { return this->total_units; }
+    int used() const { return this->used_units; }
+    // Number of free ranges; many small ones mean fragmentation
+    int free_range_count() const { return (int)this->free_ranges.size(); }
+
+  private:
+    // Offset to size of each free range
+    std::map<int, int> free_ranges;
+    int total_units = 0;
+    int used_units = 0;
+};
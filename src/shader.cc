@@ -56,31 +56,85 @@ Shader::Shader(const char *vertexPath, const char *fragmentPath) {
 
     glDeleteShader(vertexShader);
     glDeleteShader(fragmentShader);
+
+    this->cache_uniforms();
+    GLuint frame_block = glGetUniformBlockIndex(ID, "Frame");
+    if (frame_block != GL_INVALID_INDEX)
+        glUniformBlockBinding(ID, frame_block, FRAME_BLOCK_BINDING);
 }
 Shader::~Shader() { glDeleteProgram(ID); }
 
 void Shader::use() { glUseProgram(ID); }
 
+void Shader::cache_uniforms() {
+    GLint count = 0, max_length = 0;
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+    std::vector<char> buffer(max_length + 1);
+    for (GLint i = 0; i < count; i++) {
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(ID, (GLuint)i, (GLsizei)buffer.size(), nullptr,
+                           &size, &type, buffer.data());
+        std::string name = buffer.data();
+        GLint location = glGetUniformLocation(ID, name.c_str());
+        // Members of uniform blocks have no location
+        if (location < 0)
+            continue;
+
+        // Arrays are reported by their first element, "name[0]"
+        size_t bracket = name.rfind("[0]");
+        if (bracket == std::string::npos || bracket + 3 != name.size()) {
+            this->uniform_locations[name] = location;
+            continue;
+        }
+        std::string base = name.substr(0, bracket);
+        this->uniform_locations[base] = location;
+        for (GLint element = 0; element < size; element++) {
+            std::string element_name =
+                base + "[" + std::to_string(element) + "]";
+            this->uniform_locations[element_name] =
+                glGetUniformLocation(ID, element_name.c_str());
+        }
+    }
+}
+
+GLint Shader::uniform(const std::string &name) const {
+    auto found = this->uniform_locations.find(name);
+    return found == this->uniform_locations.end() ? -1 : found->second;
+}
+
 void Shader::set_bool(const std::string &name, bool value) const {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+    glUniform1i(this->uniform(name), (int)value);
 }
 void Shader::set_int(const std::string &name, int value) const {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    this->set_int(this->uniform(name), value);
 }
 void Shader::set_float(const std::string &name, float value) const {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    this->set_float(this->uniform(name), value);
 }
 void Shader::set_mat4(const std::string &name, const glm::mat4 &mat) const {
-    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE,
-                       &mat[0][0]);
+    this->set_mat4(this->uniform(name), mat);
 }
 void Shader::set_vec3(const std::string &name, const glm::vec3 &value) const {
-    glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    this->set_vec3(this->uniform(name), value);
 }
 void Shader::set_int_array(const std::string &name,
                            const std::vector<int> &values) const {
-    glUniform1iv(glGetUniformLocation(ID, name.c_str()), (GLsizei)values.size(),
-                 values.data());
+    glUniform1iv(this->uniform(name), (GLsizei)values.size(), values.data());
+}
+
+void Shader::set_int(GLint location, int value) const {
+    glUniform1i(location, value);
+}
+void Shader::set_float(GLint location, float value) const {
+    glUniform1f(location, value);
+}
+void Shader::set_mat4(GLint location, const glm::mat4 &mat) const {
+    glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]);
+}
+void Shader::set_vec3(GLint location, const glm::vec3 &value) const {
+    glUniform3fv(location, 1, &value[0]);
 }
 
 void Shader::check_compile_errors(GLuint shader, std::string type) {
@@ -2,11 +2,14 @@
 #include "glad.h"
 #include <glm/glm.hpp>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 class Shader {
   public:
     GLuint ID;
+    // Uniform buffer binding of the Frame block (see FrameUniforms)
+    static constexpr GLuint FRAME_BLOCK_BINDING = 0;
 
     Shader(const char *vertexPath, const char *fragmentPath);
     ~Shader();
@@ -14,6 +17,12 @@ class Shader {
     void use();
     static void stop() { glUseProgram(0); }
     void check_compile_errors(GLuint shader, std::string type);
+
+    // Location of an active uniform, resolved once after linking; -1 if
+    // the program has no such uniform. Uniforms set every frame should
+    // keep the location and use the setters taking it.
+    GLint uniform(const std::string &name) const;
+
     void set_bool(const std::string &name, bool value) const;
     void set_int(const std::string &name, int value) const;
     void set_float(const std::string &name, float value) const;
@@ -21,4 +30,16 @@ class Shader {
     void set_vec3(const std::string &name, const glm::vec3 &value) const;
     void set_int_array(const std::string &name,
                        const std::vector<int> &values) const;
+
+    void set_int(GLint location, int value) const;
+    void set_float(GLint location, float value) const;
+    void set_mat4(GLint location, const glm::mat4 &mat) const;
+    void set_vec3(GLint location, const glm::vec3 &value) const;
+
+  private:
+    // Every active uniform by name; array elements are listed both as
+    // "name[i]" and, for the first, as "name"
+    std::unordered_map<std::string, GLint> uniform_locations;
+
+    void cache_uniforms();
 };
@@ -0,0 +1,217 @@
+// texture_archive.h
+#pragma once
+#include "block_compression.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Copies an RGBA image into a size x size layer. Animation strips are a
+// column of square frames, so only the top square is used; any other
+// size is resampled from it with nearest filtering.
+inline void copy_texture_layer(const unsigned char *image, int width,
+                               int height, int size, unsigned char *layer) {
+    int frame = std::min(width, height);
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            const unsigned char *texel =
+                image + ((size_t)(y * frame / size) * width +
+                         x * frame / size) *
+                            4;
+            std::copy(texel, texel + 4, layer + (y * size + x) * 4);
+        }
+    }
+}
+
+// Averages each 2x2 block of an RGBA image into the next mip level, which
+// is max(width / 2, 1) x max(height / 2, 1); odd edges drop their last
+// row or column
+inline void downsample_texture(const unsigned char *image, int width,
+                               int height, unsigned char *out) {
+    int half_width = std::max(width / 2, 1);
+    int half_height = std::max(height / 2, 1);
+    int step_x = width > 1 ? 1 : 0;
+    int step_y = height > 1 ? 1 : 0;
+    for (int y = 0; y < half_height; y++) {
+        for (int x = 0; x < half_width; x++) {
+            const unsigned char *row0 =
+                image + ((size_t)y * 2 * width + x * 2) * 4;
+            const unsigned char *row1 = row0 + (size_t)step_y * width * 4;
+            for (int c = 0; c < 4; c++) {
+                int sum = row0[c] + row0[step_x * 4 + c] + row1[c] +
+                          row1[step_x * 4 + c];
+                out[((size_t)y * half_width + x) * 4 + c] =
+                    (unsigned char)((sum + 2) / 4);
+            }
+        }
+    }
+}
+
+inline void downsample_texture_layer(const unsigned char *layer, int size,
+                                     unsigned char *out) {
+    downsample_texture(layer, size, size, out);
+}
+
+// Block textures baked by tools/bake_textures.cc: every PNG of src/block
+// as a square layer with its whole mip chain, so startup maps one file
+// instead of decoding hundreds of PNGs and building mipmaps.
+//
+// Layout: the Header, then one LayerEntry per layer sorted by name, then
+// each mip level from the largest down, holding every layer's pixels back
+// to back in layer order. Pixels are RGBA8 or BCn blocks, per `format`.
+struct TextureArchive {
+    static constexpr uint32_t MAGIC = 0x41585456; // "VTXA"
+    static constexpr uint32_t VERSION = 2;
+    static constexpr int NAME_LENGTH = 64;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t size; // width and height of level 0
+        uint32_t levels;
+        uint32_t layers;
+        uint32_t format; // TextureFormat
+    };
+    struct LayerEntry {
+        char name[NAME_LENGTH]; // file name without ".png", NUL padded
+    };
+
+    TextureArchive() = default;
+    ~TextureArchive() { this->close(); }
+    TextureArchive(const TextureArchive &) = delete;
+    TextureArchive &operator=(const TextureArchive &) = delete;
+
+    // Full chain down to 1x1
+    static int mip_levels(int size) {
+        int levels = 1;
+        while (size > 1) {
+            size /= 2;
+            levels++;
+        }
+        return levels;
+    }
+    static int level_size(int size, int level) {
+        return std::max(size >> level, 1);
+    }
+    static size_t layer_bytes(TextureFormat format, int size, int level) {
+        int side = level_size(size, level);
+        return texture_bytes(format, side, side);
+    }
+    static size_t data_offset(int layers) {
+        return sizeof(Header) + layers * sizeof(LayerEntry);
+    }
+    static size_t level_offset(TextureFormat format, int size, int layers,
+                               int level) {
+        size_t offset = data_offset(layers);
+        for (int i = 0; i < level; i++)
+            offset += layer_bytes(format, size, i) * layers;
+        return offset;
+    }
+
+    // Maps the archive read-only; false if it is missing or malformed
+    bool open(const std::string &path) {
+        this->close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(Header)) {
+            void *mapping =
+                mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED) {
+                this->mapping = (const unsigned char *)mapping;
+                this->mapped_bytes = info.st_size;
+            }
+        }
+        ::close(fd);
+        if (!this->mapping || !this->valid()) {
+            std::cerr << "Invalid texture archive: " << path << std::endl;
+            this->close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (this->mapping)
+            munmap((void *)this->mapping, this->mapped_bytes);
+        this->mapping = nullptr;
+        this->mapped_bytes = 0;
+    }
+
+    bool is_open() const { return this->mapping != nullptr; }
+    size_t file_size() const { return this->mapped_bytes; }
+    int size() const { return this->header().size; }
+    int levels() const { return this->header().levels; }
+    int layers() const { return this->header().layers; }
+    TextureFormat format() const {
+        return (TextureFormat)this->header().format;
+    }
+    size_t layer_bytes(int level) const {
+        return layer_bytes(this->format(), this->size(), level);
+    }
+    const char *name(int layer) const {
+        return this->entries()[layer].name;
+    }
+
+    // Layer holding the texture `name`, -1 if the archive lacks it
+    int find(const std::string &name) const {
+        const LayerEntry *first = this->entries();
+        const LayerEntry *last = first + this->layers();
+        const LayerEntry *entry = std::lower_bound(
+            first, last, name, [](const LayerEntry &e, const std::string &n) {
+                return std::strcmp(e.name, n.c_str()) < 0;
+            });
+        if (entry == last || name != entry->name)
+            return -1;
+        return (int)(entry - first);
+    }
+
+    // Pixels of `layer` at mip `level`; the following layers come next
+    const unsigned char *layer_data(int level, int layer) const {
+        return this->mapping +
+               level_offset(this->format(), this->size(), this->layers(),
+                            level) +
+               layer * this->layer_bytes(level);
+    }
+
+  private:
+    const unsigned char *mapping = nullptr;
+    size_t mapped_bytes = 0;
+
+    const Header &header() const { return *(const Header *)this->mapping; }
+    const LayerEntry *entries() const {
+        return (const LayerEntry *)(this->mapping + sizeof(Header));
+    }
+
+    bool valid() const {
+        const Header &header = this->header();
+        if (header.magic != MAGIC || header.version != VERSION ||
+            header.size == 0 || header.size > 4096 ||
+            header.levels != (uint32_t)mip_levels(header.size) ||
+            header.layers == 0 || header.layers > (1 << 16) ||
+            header.format > (uint32_t)TextureFormat::BC7)
+            return false;
+        if (this->mapped_bytes !=
+            level_offset(this->format(), header.size, header.layers,
+                         header.levels))
+            return false;
+
+        // find() compares names with strcmp and binary searches them, so
+        // each must be NUL-terminated and the table strictly ascending
+        const LayerEntry *entries = this->entries();
+        for (uint32_t layer = 0; layer < header.layers; layer++) {
+            const char *name = entries[layer].name;
+            if (!std::memchr(name, '\0', NAME_LENGTH))
+                return false;
+            if (layer > 0 && std::strcmp(entries[layer - 1].name, name) >= 0)
+                return false;
+        }
+        return true;
+    }
+};
@@ -0,0 +1,248 @@
+// texture_residency.cc
+#include "texture_residency.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include "textures.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+TextureResidency::TextureResidency(const BlockRegistry *registry,
+                                   const std::string &archive_path) {
+    this->registry = registry;
+    int count = (int)registry->textures.size();
+    this->layers.assign(count, NOT_RESIDENT);
+    this->pins.assign(count, 0);
+    this->unpinned_entries.resize(count);
+
+    // The baked archive when present and up to date, else the PNGs
+    if (this->archive.open(archive_path)) {
+        for (const std::string &name : registry->textures) {
+            int layer = this->archive.find(name);
+            if (layer < 0) {
+                std::cerr << "Texture archive lacks " << name
+                          << ", loading PNGs instead\n";
+                this->archive_layers.clear();
+                this->archive.close();
+                break;
+            }
+            this->archive_layers.push_back(layer);
+        }
+    }
+    if (this->archive.is_open()) {
+        this->format = this->archive.format();
+        this->size = this->archive.size();
+        this->source_name = archive_path + " (" +
+                            texture_format_name(this->format) + ")";
+        if (is_block_compressed(this->format)) {
+            GLenum compressed = compressed_texture_format(this->format);
+            if (compressed) {
+                this->internal_format = compressed;
+            } else {
+                std::cerr << "No GPU support for "
+                          << texture_format_name(this->format)
+                          << ", decoding block textures to RGBA8\n";
+            }
+        }
+    } else {
+        this->source_name = "PNG files";
+    }
+    this->levels = TextureArchive::mip_levels(this->size);
+
+    this->allocate(std::min(INITIAL_LAYERS, std::max(count, 1)));
+    std::cout << "Block textures: " << count << " from "
+              << this->source_name << ", loaded on demand\n";
+}
+
+TextureResidency::~TextureResidency() { glDeleteTextures(1, &this->texture); }
+
+void TextureResidency::pin_block(Block::BlockType type) {
+    for (int face = 0; face < 6; face++) {
+        this->pin(this->registry->face_attribute(type, face) &
+                  BlockRegistry::LAYER_MASK);
+    }
+}
+
+void TextureResidency::unpin_block(Block::BlockType type) {
+    for (int face = 0; face < 6; face++) {
+        this->unpin(this->registry->face_attribute(type, face) &
+                    BlockRegistry::LAYER_MASK);
+    }
+}
+
+void TextureResidency::pin(int texture) {
+    if (texture >= (int)this->pins.size() || this->pins[texture]++ > 0)
+        return;
+    if (this->layers[texture] != NOT_RESIDENT) {
+        this->unpinned.erase(this->unpinned_entries[texture]);
+        return;
+    }
+
+    // Reuse the least recently unpinned layer once the budget is reached,
+    // otherwise grow the array up to it, and past it only when every
+    // layer is pinned
+    if (this->free_layers.empty()) {
+        if (!this->unpinned.empty() && this->layer_capacity >= this->budget) {
+            this->evict(this->unpinned.back());
+        } else {
+            GLint max_layers;
+            glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+            int capacity = std::min(this->layer_capacity * 2, (int)max_layers);
+            if (capacity > this->layer_capacity)
+                this->allocate(capacity);
+            else if (!this->unpinned.empty())
+                this->evict(this->unpinned.back());
+        }
+    }
+    if (this->free_layers.empty()) {
+        std::cerr << "Block texture array full, "
+                  << this->registry->textures[texture] << " uses layer 0\n";
+        return;
+    }
+    int layer = this->free_layers.back();
+    this->free_layers.pop_back();
+    this->layers[texture] = layer;
+    this->layer_textures[layer] = texture;
+    auto start = std::chrono::steady_clock::now();
+    this->load(texture, layer);
+    this->load_time_ms += std::chrono::duration<double, std::milli>(
+                              std::chrono::steady_clock::now() - start)
+                              .count();
+    this->loads++;
+}
+
+void TextureResidency::unpin(int texture) {
+    if (texture >= (int)this->pins.size() || --this->pins[texture] > 0)
+        return;
+    if (this->layers[texture] == NOT_RESIDENT)
+        return;
+    this->unpinned.push_front(texture);
+    this->unpinned_entries[texture] = this->unpinned.begin();
+    this->trim();
+}
+
+void TextureResidency::trim() {
+    while (this->resident() > this->budget && !this->unpinned.empty())
+        this->evict(this->unpinned.back());
+}
+
+void TextureResidency::evict(int texture) {
+    this->unpinned.erase(this->unpinned_entries[texture]);
+    int layer = this->layers[texture];
+    this->layers[texture] = NOT_RESIDENT;
+    this->layer_textures[layer] = -1;
+    this->free_layers.push_back(layer);
+    this->evictions++;
+}
+
+void TextureResidency::bind() const {
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, this->texture);
+}
+
+size_t TextureResidency::memory_usage() const {
+    TextureFormat stored =
+        this->internal_format == GL_RGBA8 ? TextureFormat::RGBA8
+                                          : this->format;
+    size_t bytes = 0;
+    for (int level = 0; level < this->levels; level++)
+        bytes += TextureArchive::layer_bytes(stored, this->size, level);
+    return bytes * this->layer_capacity;
+}
+
+// (Re)creates the array with `capacity` layers and reloads the resident
+// textures into the layers they had
+void TextureResidency::allocate(int capacity) {
+    if (this->texture)
+        glDeleteTextures(1, &this->texture);
+    glGenTextures(1, &this->texture);
+    this->bind();
+    bool compressed = this->internal_format != GL_RGBA8;
+    for (int level = 0; level < this->levels; level++) {
+        int side = TextureArchive::level_size(this->size, level);
+        if (compressed) {
+            size_t bytes =
+                TextureArchive::layer_bytes(this->format, this->size, level);
+            glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level,
+                                   this->internal_format, side, side,
+                                   capacity, 0, (GLsizei)(bytes * capacity),
+                                   nullptr);
+        } else {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, side, side,
+                         capacity, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        }
+    }
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL,
+                    this->levels - 1);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                    GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+    int old_capacity = this->layer_capacity;
+    this->layer_capacity = capacity;
+    this->layer_textures.resize(capacity, -1);
+    for (int layer = capacity - 1; layer >= old_capacity; layer--)
+        this->free_layers.push_back(layer);
+    for (int layer = 0; layer < old_capacity; layer++) {
+        if (this->layer_textures[layer] >= 0)
+            this->load(this->layer_textures[layer], layer);
+    }
+}
+
+// Uploads every mip level of a registry texture into `layer`
+void TextureResidency::load(int texture, int layer) {
+    // Other code moves the active unit (Model draws on unit 15), so the
+    // array is bound here rather than assumed
+    this->bind();
+    bool compressed = this->internal_format != GL_RGBA8;
+    if (this->archive.is_open()) {
+        int source = this->archive_layers[texture];
+        for (int level = 0; level < this->levels; level++) {
+            int side = TextureArchive::level_size(this->size, level);
+            const unsigned char *data = this->archive.layer_data(level, source);
+            if (compressed) {
+                glCompressedTexSubImage3D(
+                    GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, side, side, 1,
+                    this->internal_format,
+                    (GLsizei)this->archive.layer_bytes(level), data);
+                continue;
+            }
+            if (is_block_compressed(this->format)) {
+                this->scratch.resize((size_t)side * side * 4);
+                decompress_texture(this->format, data, side, side,
+                                   this->scratch.data());
+                data = this->scratch.data();
+            }
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, side,
+                            side, 1, GL_RGBA, GL_UNSIGNED_BYTE, data);
+        }
+        return;
+    }
+
+    // A PNG, resampled to the layer size with its mip chain built here;
+    // one that fails to load stays transparent
+    std::string path = this->registry->textures[texture] + ".png";
+    int width, height, channels;
+    unsigned char *image =
+        stbi_load(path.c_str(), &width, &height, &channels, 4);
+    if (!image)
+        std::cerr << "Failed to load texture: " << path << std::endl;
+    size_t level_bytes = (size_t)this->size * this->size * 4;
+    this->scratch.assign(level_bytes * 2, 0);
+    unsigned char *pixels = this->scratch.data();
+    unsigned char *next = pixels + level_bytes;
+    if (image) {
+        copy_texture_layer(image, width, height, this->size, pixels);
+        stbi_image_free(image);
+    }
+    for (int level = 0; level < this->levels; level++) {
+        int side = TextureArchive::level_size(this->size, level);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, side, side,
+                        1, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        if (level + 1 < this->levels) {
+            downsample_texture_layer(pixels, side, next);
+            std::swap(pixels, next);
+        }
+    }
+}
@@ -0,0 +1,97 @@
+// texture_residency.h
+#pragma once
+#include "block_registry.h"
+#include "glad.h"
+#include "texture_archive.h"
+#include <list>
+#include <string>
+#include <vector>
+
+// The block texture array, holding only the textures some chunk uses.
+// Chunks pin the textures of their block types before meshing; the first
+// pin gives a texture a layer and loads its pixels, from the baked
+// archive when there is one and from the PNG otherwise. Textures no chunk
+// pins keep their layer, least recently unpinned evicted first, while
+// more than `budget` layers are resident. The array doubles when every
+// layer is pinned; layers keep their index when it does, so meshes built
+// against them stay valid.
+//
+// The mesher reads layer() on worker threads. Only the main thread pins,
+// and a pinned texture's layer never changes, so a mesh job reading the
+// textures its chunk pinned before dispatch needs no locking.
+struct TextureResidency {
+    static constexpr int INITIAL_LAYERS = 64;
+    static constexpr uint16_t NOT_RESIDENT = 0xFFFF;
+
+    // Resident layers kept when unpinned textures can be evicted
+    int budget = 256;
+    // Textures loaded and evicted so far, and the time spent loading
+    int loads = 0;
+    int evictions = 0;
+    double load_time_ms = 0.0;
+
+    TextureResidency(const BlockRegistry *registry,
+                     const std::string &archive_path);
+    ~TextureResidency();
+    TextureResidency(const TextureResidency &) = delete;
+    TextureResidency &operator=(const TextureResidency &) = delete;
+
+    void pin_block(Block::BlockType type);
+    void unpin_block(Block::BlockType type);
+    void pin(int texture);
+    void unpin(int texture);
+    // Evicts unpinned textures past the budget
+    void trim();
+
+    // Array layer of a registry texture; 0 for one that is not resident
+    int layer(int texture) const {
+        uint16_t layer = this->layers[texture];
+        return layer == NOT_RESIDENT ? 0 : layer;
+    }
+    // A BlockRegistry face attribute with its texture replaced by the layer
+    int face_attribute(int attribute) const {
+        return (attribute & ~BlockRegistry::LAYER_MASK) |
+               this->layer(attribute & BlockRegistry::LAYER_MASK);
+    }
+
+    // Binds the array on texture unit 0, where fragment.glsl samples it
+    void bind() const;
+
+    int capacity() const { return this->layer_capacity; }
+    int resident() const {
+        return this->layer_capacity - (int)this->free_layers.size();
+    }
+    int pinned() const { return this->resident() - (int)this->unpinned.size(); }
+    size_t memory_usage() const;
+    // Where pixels come from, e.g. "blocks.vtx (BC3)"
+    const std::string &source() const { return this->source_name; }
+
+  private:
+    const BlockRegistry *registry;
+    TextureArchive archive;
+    // Archive layer of each registry texture, empty when loading PNGs
+    std::vector<int> archive_layers;
+    std::string source_name;
+    TextureFormat format = TextureFormat::RGBA8;
+    // Format the array is stored in; compressed formats the driver cannot
+    // sample are decoded to RGBA8 on load
+    GLenum internal_format = GL_RGBA8;
+    int size = 16;
+    int levels = 1;
+
+    uint texture = 0;
+    int layer_capacity = 0;
+    // Registry texture -> layer, and layer -> registry texture or -1
+    std::vector<uint16_t> layers;
+    std::vector<int> layer_textures;
+    std::vector<int> pins;
+    std::vector<int> free_layers;
+    // Resident textures with no pins, most recently unpinned first
+    std::list<int> unpinned;
+    std::vector<std::list<int>::iterator> unpinned_entries;
+    std::vector<unsigned char> scratch;
+
+    void allocate(int capacity);
+    void load(int texture, int layer);
+    void evict(int texture);
+};
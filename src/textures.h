@@ -1,11 +1,50 @@
 #pragma once
-#define STB_IMAGE_IMPLEMENTATION
 #include "glad.h"
 #include "stb_image.h"
+#include "texture_archive.h"
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <iostream>
 #include <string>
 
+// From EXT_texture_compression_s3tc, which the core profile glad was
+// generated for does not include
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+
+inline bool has_gl_extension(const char *name) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++) {
+        const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+        if (extension && std::strcmp(extension, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+// GL format that samples `format` as is, 0 when the driver lacks it
+inline GLenum compressed_texture_format(TextureFormat format) {
+    switch (format) {
+    case TextureFormat::BC1:
+        return has_gl_extension("GL_EXT_texture_compression_s3tc")
+                   ? GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+                   : 0;
+    case TextureFormat::BC3:
+        return has_gl_extension("GL_EXT_texture_compression_s3tc")
+                   ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+                   : 0;
+    case TextureFormat::BC7:
+        return GLAD_GL_VERSION_4_2 ||
+                       has_gl_extension("GL_ARB_texture_compression_bptc")
+                   ? GL_COMPRESSED_RGBA_BPTC_UNORM
+                   : 0;
+    default:
+        return 0;
+    }
+}
+
 inline uint load_textures_from_file(const std::string &path,
                                     bool generateMipmaps = true) {
     int width, height, channels;
@@ -1,27 +1,40 @@
 #version 410 core
-layout(location = 0) in vec3 aPos;
-layout(location = 1) in vec2 aTexCoord;
-layout(location = 2) in vec3 aNormal;
-layout(location = 3) in int aTextureIndex;
+layout(location = 0) in uvec2 aVertex; // see Chunk::Vertex
+layout(location = 1) in ivec2 aChunk;  // chunk coordinates, see ChunkBuffer
 
 out vec2 TexCoord;
 out vec3 FragPos;
 out vec3 Normal;
 flat out int TextureIndex;
+flat out int TintIndex;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform float time;
+layout(std140) uniform Frame { // see FrameUniforms
+    mat4 view;
+    mat4 projection;
+    float time;
+};
+
+// Indexed by Chunk face order: top, bottom, front, back, left, right
+const vec3 faceNormals[6] = vec3[](vec3(0, 1, 0), vec3(0, -1, 0),
+                                   vec3(0, 0, 1), vec3(0, 0, -1),
+                                   vec3(-1, 0, 0), vec3(1, 0, 0));
 
 void main() {
+    uint position = aVertex.x;
+    uint surface = aVertex.y;
+    vec3 aPos = vec3(position & 63u, (position >> 6) & 63u,
+                     (position >> 12) & 63u);
+    vec2 aTexCoord = vec2(surface & 63u, (surface >> 6) & 63u);
+    int aFaceAttribute = int(surface >> 12); // see BlockRegistry
+
     TexCoord = vec2(aTexCoord.x, 1.0 - aTexCoord.y);
-    TextureIndex = aTextureIndex;
-    Normal = aNormal;
+    TextureIndex = aFaceAttribute & 0xFFF;
+    TintIndex = (aFaceAttribute >> 12) & 0xF;
+    Normal = faceNormals[(position >> 18) & 7u];
     vec3 modifiedPos = aPos;
     
-    // Leaf texture animation
-    if (TextureIndex == 4) {
+    // Wind animation for blocks flagged animated in blocks.txt
+    if ((aFaceAttribute & (1 << 16)) != 0) {
         float windStrength = 0.1; 
         float windSpeed = 1.5;    
         float waveX = sin(time * windSpeed + aPos.x * 0.5 + aPos.z * 0.3) * windStrength;
@@ -33,6 +46,6 @@ void main() {
         modifiedPos.y += (waveX + waveZ) * 0.2;
     }
     
-    FragPos = vec3(model * vec4(modifiedPos, 1.0));
-    gl_Position = projection * view * model * vec4(modifiedPos, 1.0);
+    FragPos = modifiedPos + vec3(aChunk.x, 0, aChunk.y) * 32.0;
+    gl_Position = projection * view * vec4(FragPos, 1.0);
 }
@@ -0,0 +1,96 @@
+// worker_pool.h
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed pool of worker threads. A job runs on a worker and returns a
+// completion that poll() later runs on the owning thread, so results are
+// handed back without the caller sharing any state with the workers.
+struct WorkerPool {
+    using Completion = std::function<void()>;
+    using Job = std::function<Completion()>;
+
+    explicit WorkerPool(int threads = default_threads()) {
+        for (int i = 0; i < threads; i++)
+            this->workers.emplace_back([this] { this->run(); });
+    }
+    // Drops jobs that have not started and waits for the running ones
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->stopping = true;
+            this->jobs.clear();
+        }
+        this->wake.notify_all();
+        for (std::thread &worker : this->workers)
+            worker.join();
+    }
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    // Leaves one core for the render thread
+    static int default_threads() {
+        return std::max(1, (int)std::thread::hardware_concurrency() - 1);
+    }
+
+    void submit(Job job) {
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->jobs.push_back(std::move(job));
+            this->in_flight++;
+        }
+        this->wake.notify_one();
+    }
+
+    // Runs the completions of every job finished so far
+    void poll() {
+        std::vector<Completion> done;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            done.swap(this->completed);
+            this->in_flight -= (int)done.size();
+        }
+        for (Completion &completion : done)
+            completion();
+    }
+
+    // Jobs submitted whose completion has not been polled yet
+    int pending() const {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        return this->in_flight;
+    }
+    int thread_count() const { return (int)this->workers.size(); }
+
+  private:
+    std::vector<std::thread> workers;
+    std::deque<Job> jobs;
+    std::vector<Completion> completed;
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    int in_flight = 0;
+
+    void run() {
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(this->mutex);
+                this->wake.wait(lock, [this] {
+                    return this->stopping || !this->jobs.empty();
+                });
+                if (this->stopping)
+                    return;
+                job = std::move(this->jobs.front());
+                this->jobs.pop_front();
+            }
+            Completion completion = job();
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->completed.push_back(std::move(completion));
+        }
+    }
+};
@@ -0,0 +1,168 @@
+// bake_textures.cc
+// Packs every PNG of a block texture folder into one TextureArchive with
+// precomputed mip chains, so the game maps a single file at startup.
+// Usage: bake_textures <block dir> <archive> [RGBA8|BC1|BC3|BC7]
+//
+// Also reports the startup work the archive replaces: decoding the PNGs
+// and building their mipmaps, against mapping the archive and reading
+// every byte of it.
+#define STB_IMAGE_IMPLEMENTATION
+#include "block_compression.h"
+#include "stb_image.h"
+#include "texture_archive.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+constexpr int LAYER_SIZE = 16;
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+int main(int argc, char **argv) {
+    TextureFormat format = TextureFormat::RGBA8;
+    if (argc < 3 || argc > 4 ||
+        (argc == 4 && !parse_texture_format(argv[3], format))) {
+        std::fprintf(stderr,
+                     "Usage: %s <block dir> <archive> [RGBA8|BC1|BC3|BC7]\n",
+                     argv[0]);
+        return 1;
+    }
+    std::vector<std::string> names;
+    std::error_code error;
+    for (const auto &entry :
+         std::filesystem::directory_iterator(argv[1], error)) {
+        if (entry.path().extension() == ".png")
+            names.push_back(entry.path().stem().string());
+    }
+    if (error || names.empty()) {
+        std::fprintf(stderr, "No PNG files in %s\n", argv[1]);
+        return 1;
+    }
+    // TextureArchive::find binary searches the names
+    std::sort(names.begin(), names.end());
+
+    auto start = std::chrono::steady_clock::now();
+    int layers = (int)names.size();
+    int levels = TextureArchive::mip_levels(LAYER_SIZE);
+    // RGBA mip chain of every layer, level 0 first
+    std::vector<unsigned char> chains;
+    std::vector<size_t> chain_offsets(levels);
+    for (int level = 0; level < levels; level++) {
+        chain_offsets[level] =
+            level ? chain_offsets[level - 1] +
+                        TextureArchive::layer_bytes(TextureFormat::RGBA8,
+                                                    LAYER_SIZE, level - 1)
+                  : 0;
+    }
+    size_t chain_bytes =
+        chain_offsets[levels - 1] +
+        TextureArchive::layer_bytes(TextureFormat::RGBA8, LAYER_SIZE,
+                                    levels - 1);
+    chains.resize(chain_bytes * layers);
+    for (int layer = 0; layer < layers; layer++) {
+        if (names[layer].size() >= TextureArchive::NAME_LENGTH) {
+            std::fprintf(stderr, "Texture name too long: %s\n",
+                         names[layer].c_str());
+            return 1;
+        }
+        std::string path =
+            (std::filesystem::path(argv[1]) / (names[layer] + ".png"))
+                .string();
+        int width, height, channels;
+        unsigned char *image =
+            stbi_load(path.c_str(), &width, &height, &channels, 4);
+        if (!image) {
+            std::fprintf(stderr, "Failed to load texture: %s\n",
+                         path.c_str());
+            return 1;
+        }
+        unsigned char *chain = chains.data() + layer * chain_bytes;
+        copy_texture_layer(image, width, height, LAYER_SIZE, chain);
+        stbi_image_free(image);
+        for (int level = 1; level < levels; level++) {
+            downsample_texture_layer(
+                chain + chain_offsets[level - 1],
+                TextureArchive::level_size(LAYER_SIZE, level - 1),
+                chain + chain_offsets[level]);
+        }
+    }
+    double decode_ms = elapsed_ms(start);
+
+    // Archive order: by level, then by layer
+    start = std::chrono::steady_clock::now();
+    size_t data_offset = TextureArchive::data_offset(layers);
+    std::vector<unsigned char> data(
+        TextureArchive::level_offset(format, LAYER_SIZE, layers, levels) -
+        data_offset);
+    for (int level = 0; level < levels; level++) {
+        int side = TextureArchive::level_size(LAYER_SIZE, level);
+        size_t layer_bytes =
+            TextureArchive::layer_bytes(format, LAYER_SIZE, level);
+        unsigned char *out =
+            data.data() +
+            TextureArchive::level_offset(format, LAYER_SIZE, layers, level) -
+            data_offset;
+        for (int layer = 0; layer < layers; layer++) {
+            compress_texture(format,
+                             chains.data() + layer * chain_bytes +
+                                 chain_offsets[level],
+                             side, side, out + layer * layer_bytes);
+        }
+    }
+    double encode_ms = elapsed_ms(start);
+
+    TextureArchive::Header header = {TextureArchive::MAGIC,
+                                     TextureArchive::VERSION, LAYER_SIZE,
+                                     (uint32_t)levels, (uint32_t)layers,
+                                     (uint32_t)format};
+    std::vector<TextureArchive::LayerEntry> entries(layers);
+    for (int layer = 0; layer < layers; layer++) {
+        std::memset(entries[layer].name, 0, TextureArchive::NAME_LENGTH);
+        names[layer].copy(entries[layer].name, names[layer].size());
+    }
+    FILE *file = std::fopen(argv[2], "wb");
+    if (!file) {
+        std::fprintf(stderr, "Failed to write %s\n", argv[2]);
+        return 1;
+    }
+    bool written =
+        std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+        std::fwrite(entries.data(), sizeof(entries[0]), layers, file) ==
+            (size_t)layers &&
+        std::fwrite(data.data(), 1, data.size(), file) == data.size();
+    if (std::fclose(file) != 0 || !written) {
+        std::fprintf(stderr, "Failed to write %s\n", argv[2]);
+        return 1;
+    }
+
+    start = std::chrono::steady_clock::now();
+    TextureArchive archive;
+    if (!archive.open(argv[2]))
+        return 1;
+    unsigned checksum = 0;
+    for (int level = 0; level < archive.levels(); level++) {
+        const unsigned char *pixels = archive.layer_data(level, 0);
+        size_t bytes = archive.layer_bytes(level) * layers;
+        for (size_t i = 0; i < bytes; i++)
+            checksum += pixels[i];
+    }
+    double map_ms = elapsed_ms(start);
+
+    std::printf("Baked %d textures, %d mip levels, into %s (%s, %zu KB)\n",
+                layers, levels, argv[2], texture_format_name(format),
+                archive.file_size() >> 10);
+    if (is_block_compressed(format))
+        std::printf("%s encode: %.2f ms\n", texture_format_name(format),
+                    encode_ms);
+    std::printf("PNG decode + mipmaps: %.2f ms, archive map + read: %.2f ms "
+                "(checksum %u)\n",
+                decode_ms, map_ms, checksum);
+    return 0;
+}